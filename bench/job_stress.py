@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Job-table stress test: thousands of background jobs.
+
+Usage: job_stress.py SHELL [N ...]   (default N: 1000 2000)
+
+For each N the shell runs a script that starts N background jobs, half
+long-running sleeps and half `true`, then runs `jobs` 100 times, starts
+N/2 more `true` jobs and times a final `jobs`.  Prints the wall time, the
+shell's CPU time and the final `jobs` time.
+"""
+import os, resource, subprocess, sys, tempfile, time
+
+# Distinctive, so cleanup only kills this benchmark's sleeps.
+SLEEP = 'sleep 31.25'
+
+
+def run(shell, n, tmp):
+    # The sleeps must not hold the stderr pipe open past the shell's exit.
+    lines = [f'{SLEEP} 2>/dev/null &' if i % 2 else 'true &' for i in range(n)]
+    lines += ['jobs >/dev/null'] * 100
+    lines += ['true &'] * (n // 2) + ['time jobs >/dev/null']
+    script = os.path.join(tmp, 'jobs.sh')
+    with open(script, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+    before = resource.getrusage(resource.RUSAGE_CHILDREN)
+    start = time.time()
+    result = subprocess.run([shell, script], stdout=subprocess.DEVNULL,
+                            stderr=subprocess.PIPE, text=True)
+    wall = time.time() - start
+    after = resource.getrusage(resource.RUSAGE_CHILDREN)
+    subprocess.run(['pkill', '-f', f'^{SLEEP}$'])
+
+    final = next((l.split()[1] for l in result.stderr.splitlines() if l.startswith('real')), '?')
+    print(f'N={n:<6} wall {wall:.2f}s  shell user {after.ru_utime - before.ru_utime:.2f}s'
+          f'  sys {after.ru_stime - before.ru_stime:.2f}s  final jobs {final}')
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    shell = os.path.abspath(sys.argv[1])
+    counts = [int(n) for n in sys.argv[2:]] or [1000, 2000]
+    with tempfile.TemporaryDirectory() as tmp:
+        for n in counts:
+            run(shell, n, tmp)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,57 @@
+/**
+ * @file spawn_latency.cpp
+ * @brief Launch latency of fork()+exec() against posix_spawn() from a
+ *        process with a large resident heap.
+ *
+ * Usage: bench_spawn [heap-MB [launches]]   (defaults: 512, 300)
+ *
+ * fork() copies the page tables of the whole heap before the child can
+ * exec, so its cost grows with the parent's RSS; posix_spawn() borrows
+ * the address space (CLONE_VM | CLONE_VFORK) and stays flat.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+extern char** environ;
+
+int main(int argc, char** argv) {
+  size_t heap_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 512;
+  int launches = argc > 2 ? atoi(argv[2]) : 300;
+  if (launches <= 0) launches = 300;
+
+  // Touch every page so it is resident and fork() has to copy its mapping.
+  vector<char> heap(heap_mb << 20);
+  memset(heap.data(), 1, heap.size());
+
+  char* args[] = {const_cast<char*>("/bin/true"), nullptr};
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < launches; ++i) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      execv(args[0], args);
+      _exit(127);
+    }
+    waitpid(pid, nullptr, 0);
+  }
+  auto forked = chrono::steady_clock::now();
+  for (int i = 0; i < launches; ++i) {
+    pid_t pid;
+    if (posix_spawn(&pid, args[0], nullptr, nullptr, args, environ) == 0) waitpid(pid, nullptr, 0);
+  }
+  auto spawned = chrono::steady_clock::now();
+
+  auto perLaunch = [&](auto elapsed) {
+    return chrono::duration<double, micro>(elapsed).count() / launches;
+  };
+  printf("rss=%zuMB  fork+exec %.0fus  posix_spawn %.0fus\n", heap_mb,
+         perLaunch(forked - start), perLaunch(spawned - forked));
+  return 0;
+}
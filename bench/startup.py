@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+"""Time from launching the shell on a pty until its first prompt.
+
+Usage: startup.py SHELL [--lines N] [--runs N]
+
+A HISTFILE of N lines (default 500000) is generated in a temporary
+directory and the shell is started with HISTFILESIZE=-1, so the whole file
+is eligible for loading.  Prints the median and minimum over the runs.
+"""
+import argparse, os, pty, select, statistics, sys, tempfile, time
+
+
+def first_prompt(shell, env):
+    start = time.perf_counter()
+    pid, fd = pty.fork()
+    if pid == 0:
+        os.execve(shell, [shell], env)
+    out = b''
+    while b'$ ' not in out:
+        ready, _, _ = select.select([fd], [], [], 10)
+        if not ready:
+            sys.exit('timed out waiting for the prompt')
+        out += os.read(fd, 4096)
+    elapsed = time.perf_counter() - start
+    os.write(fd, b'exit\n')
+    try:
+        while os.read(fd, 4096):
+            pass
+    except OSError:
+        pass
+    os.waitpid(pid, 0)
+    return elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('shell')
+    parser.add_argument('--lines', type=int, default=500000)
+    parser.add_argument('--runs', type=int, default=7)
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        histfile = os.path.join(tmp, 'history')
+        with open(histfile, 'w') as f:
+            for i in range(args.lines):
+                f.write(f'git commit -m "change {i}" --author someone\n')
+        env = dict(os.environ, HISTFILE=histfile, HISTFILESIZE='-1', HISTSIZE='-1')
+        times = [first_prompt(os.path.abspath(args.shell), env) for _ in range(args.runs)]
+    print(f'{args.lines} history lines: first prompt median {statistics.median(times) * 1000:.1f} ms'
+          f'  min {min(times) * 1000:.1f} ms')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,510 @@
+/**
+ * @file builtins.cpp
+ * @brief Implementations of the shell built-in commands.
+ */
+#include "builtins.h"
+#include "completer.h"
+#include "executor.h"
+#include "histfile.h"
+#include "histlist.h"
+#include "histsearch.h"
+#include "jobs.h"
+#include "pathcache.h"
+#include "rlimits.h"
+#include "timing.h"
+#include "trace.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <unistd.h>
+#include <readline/history.h>
+
+using namespace std;
+
+static int runExit(const vector<string>& args) {
+  exit_requested() = true;
+  int code = last_status();
+  if (args.size() > 1) from_chars(args[1].data(), args[1].data() + args[1].size(), code);
+  return code & 0xff;
+}
+
+static int runEcho(const vector<string>& args) {
+  for (size_t i = 1; i < args.size(); ++i) {
+    if (i > 1) cout << " ";
+    cout << args[i];
+  }
+  cout << '\n';
+  return 0;
+}
+
+static int runType(const vector<string>& args) {
+  if (args.size() <= 1) return 0;
+  const string& arg = args[1];
+  if (arg == "time")  { cout << arg << " is a shell keyword\n"; return 0; }
+  if (isBuiltin(arg)) { cout << arg << " is a shell builtin\n"; return 0; }
+  string path = findInPath(arg);
+  if (path.empty()) { cout << arg << ": not found\n"; return 1; }
+  cout << arg << " is " << path << '\n';
+  return 0;
+}
+
+static int runPwd(const vector<string>&) {
+  string cwd(1024, '\0');
+  if (getcwd(cwd.data(), cwd.size()) == nullptr) {
+    cerr << "pwd: error getting current directory" << endl;
+    return 1;
+  }
+  cout << cwd.c_str() << '\n';
+  return 0;
+}
+
+static int runHistoryRead(const string& filename) {
+  if (!readHistoryFile(filename)) { cerr << "history: " << filename << ": No such file or directory" << endl; return 1; }
+  return 0;
+}
+
+static int runHistoryAppend(const string& filename) {
+  int start = (last_appended_index() == -1) ? history_base : last_appended_index() + 1;
+  int end = history_base + history_length;
+  if (!appendHistoryFile(filename, start, end)) { cerr << "history: " << filename << ": cannot create" << endl; return 1; }
+  last_appended_index() = end - 1;
+  return 0;
+}
+
+static int runHistoryWrite(const string& filename) {
+  if (!writeHistoryFile(filename)) { cerr << "history: " << filename << ": cannot create" << endl; return 1; }
+  return 0;
+}
+
+static int runHistoryList(const vector<string>& args) {
+  int end = history_base + history_length;
+  int start = history_base;
+  if (args.size() > 1 && args[1] != "-r" && args[1] != "-w" && args[1] != "-a") {
+    start = max(history_base, end - stoi(args[1]));
+  }
+  for (int i = start; i < end; ++i) {
+    const HIST_ENTRY* entry = history_get(i);
+    if (entry) cout << "    " << i << "  " << entry->line << '\n';
+  }
+  return 0;
+}
+
+static int runHistorySearch(const vector<string>& args) {
+  if (args.size() < 3) {
+    cerr << "history: -s: pattern expected" << endl;
+    return 2;
+  }
+  string pattern = args[2];
+  for (size_t i = 3; i < args.size(); ++i) pattern += ' ' + args[i];
+  vector<string> matches = searchHistory(pattern, numeric_limits<size_t>::max());
+  for (const auto& line : matches) cout << line << '\n';
+  return matches.empty() ? 1 : 0;
+}
+
+// `history --stats`: the slowest entries, then the most frequent lines
+// with their total time, over the in-memory history.
+static int runHistoryStats() {
+  constexpr size_t kTop = 10;
+  struct LineStats { int runs = 0; double total = 0; };
+  vector<pair<double, const HIST_ENTRY*>> timed;
+  unordered_map<string_view, LineStats> by_line;
+  for (int i = history_base; i < history_base + history_length; ++i) {
+    const HIST_ENTRY* entry = history_get(i);
+    if (!entry) continue;
+    HistoryStamp stamp = parseHistoryStamp(entry->timestamp);
+    LineStats& line = by_line[entry->line];
+    ++line.runs;
+    if (stamp.seconds < 0) continue;
+    line.total += stamp.seconds;
+    timed.emplace_back(stamp.seconds, entry);
+  }
+
+  size_t n = min(kTop, timed.size());
+  ranges::partial_sort(timed, timed.begin() + n, greater{}, &pair<double, const HIST_ENTRY*>::first);
+  ios_base::fmtflags flags = cout.flags();
+  streamsize precision = cout.precision();
+  cout << "slowest commands:\n" << fixed << setprecision(3);
+  for (size_t i = 0; i < n; ++i) {
+    HistoryStamp stamp = parseHistoryStamp(timed[i].second->timestamp);
+    cout << right << setw(12) << timed[i].first << "s  status " << left << setw(3) << stamp.status
+         << "  " << timed[i].second->line << '\n';
+  }
+
+  vector<pair<string_view, LineStats>> frequent(by_line.begin(), by_line.end());
+  n = min(kTop, frequent.size());
+  ranges::partial_sort(frequent, frequent.begin() + n, [](const auto& a, const auto& b) {
+    return a.second.runs != b.second.runs ? a.second.runs > b.second.runs : a.second.total > b.second.total;
+  });
+  cout << "most frequent commands:\n";
+  for (size_t i = 0; i < n; ++i) {
+    cout << right << setw(6) << frequent[i].second.runs << " runs " << setw(12)
+         << frequent[i].second.total << "s total  " << frequent[i].first << '\n';
+  }
+  cout.flags(flags);
+  cout.precision(precision);
+  return 0;
+}
+
+static int runHistory(const vector<string>& args) {
+  materializeHistory();
+  if (args.size() > 1 && args[1] == "--stats") return runHistoryStats();
+  if (args.size() > 1 && args[1] == "-s") return runHistorySearch(args);
+  if (args.size() > 2 && args[1] == "-r") return runHistoryRead(args[2]);
+  if (args.size() > 2 && args[1] == "-a") return runHistoryAppend(args[2]);
+  if (args.size() > 2 && args[1] == "-w") return runHistoryWrite(args[2]);
+  return runHistoryList(args);
+}
+
+static int runJobs(const vector<string>&) {
+  listJobs();
+  return 0;
+}
+
+static int runWait(const vector<string>& args) {
+  bool any = args.size() > 1 && args[1] == "-n";
+  return waitForJobs(vector<string>(args.begin() + (any ? 2 : 1), args.end()), any);
+}
+
+static int runFg(const vector<string>& args) {
+  return resumeJob(args.size() > 1 ? args[1] : "", true);
+}
+
+static int runBg(const vector<string>& args) {
+  return resumeJob(args.size() > 1 ? args[1] : "", false);
+}
+
+static int runDisown(const vector<string>& args) {
+  return disownJobs(vector<string>(args.begin() + 1, args.end()));
+}
+
+namespace {
+
+constexpr array<pair<string_view, int>, 15> kSignals = {{
+  {"HUP",  SIGHUP},  {"INT",  SIGINT},  {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+  {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+  {"TERM", SIGTERM}, {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP},
+  {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU},
+}};
+
+} // namespace
+
+// Parses a signal given as a number, NAME or SIGNAME; returns 0 if unknown.
+static int parseSignal(string_view name) {
+  int sig = 0;
+  auto [end, ec] = from_chars(name.data(), name.data() + name.size(), sig);
+  if (ec == errc() && end == name.data() + name.size()) return sig > 0 && sig < NSIG ? sig : 0;
+  if (name.starts_with("SIG")) name.remove_prefix(3);
+  auto it = ranges::find(kSignals, name, &pair<string_view, int>::first);
+  return it == kSignals.end() ? 0 : it->second;
+}
+
+static int runKill(const vector<string>& args) {
+  if (args.size() > 1 && args[1] == "-l") {
+    for (const auto& [name, sig] : kSignals) cout << setw(2) << right << sig << ") SIG" << name << '\n';
+    return 0;
+  }
+  int sig = SIGTERM;
+  size_t i = 1;
+  if (i < args.size() && (args[i] == "-s" || args[i] == "-n") && i + 1 < args.size()) {
+    sig = parseSignal(args[i + 1]);
+    i += 2;
+  } else if (i < args.size() && args[i].size() > 1 && args[i][0] == '-') {
+    sig = parseSignal(string_view(args[i]).substr(1));
+    ++i;
+  }
+  if (sig == 0) { cerr << "kill: " << args[i - 1] << ": invalid signal specification" << endl; return 1; }
+  if (i >= args.size()) {
+    cerr << "kill: usage: kill [-s sigspec | -n signum | -sigspec] pid | jobspec ... or kill -l" << endl;
+    return 2;
+  }
+  int status = 0;
+  for (; i < args.size(); ++i) {
+    if (args[i].starts_with('%')) { status |= killJob(args[i], sig); continue; }
+    pid_t pid = 0;
+    auto [end, ec] = from_chars(args[i].data(), args[i].data() + args[i].size(), pid);
+    if (ec != errc() || end != args[i].data() + args[i].size()) {
+      cerr << "kill: " << args[i] << ": arguments must be process or job IDs" << endl;
+      status = 1;
+    } else if (kill(pid, sig) != 0) {
+      cerr << "kill: (" << pid << ") - " << strerror(errno) << endl;
+      status = 1;
+    }
+  }
+  return status;
+}
+
+static int runComplete(const vector<string>& args) {
+  if (args.size() > 3 && (args[1] == "-C" || args[1] == "-S")) {
+    completion_registry()[args[3]] = {args[2], args[1] == "-S"};
+    syncCompleters();
+    return 0;
+  }
+  if (args.size() > 2 && args[1] == "-r") {
+    completion_registry().erase(args[2]);
+    syncCompleters();
+    return 0;
+  }
+  if (args.size() > 2 && args[1] == "-p") {
+    const string& cmd = args[2];
+    auto it = completion_registry().find(cmd);
+    if (it == completion_registry().end()) {
+      cerr << "complete: " << cmd << ": no completion specification" << endl;
+      return 1;
+    }
+    const CompletionSpec& spec = it->second;
+    cout << "complete " << (spec.server ? "-S" : "-C") << " '" << spec.completer << "' " << cmd << '\n';
+  }
+  return 0;
+}
+
+static int runDeclareShow(const string& varname) {
+  auto it = shell_variables().find(varname);
+  if (it == shell_variables().end()) { cerr << "declare: " << varname << ": not found" << endl; return 1; }
+  cout << "declare -- " << it->first << "=\"" << it->second << "\"\n";
+  return 0;
+}
+
+static int runDeclareSet(const string& assignment) {
+  size_t eq = assignment.find('=');
+  if (eq == string::npos) return 0;
+  string varname = assignment.substr(0, eq);
+  bool valid = !varname.empty()
+    && (isalpha(static_cast<unsigned char>(varname[0])) || varname[0] == '_')
+    && all_of(varname.begin() + 1, varname.end(),
+              [](unsigned char c){ return isalnum(c) || c == '_'; });
+  if (!valid) { cerr << "declare: `" << assignment << "': not a valid identifier" << endl; return 1; }
+  shell_variables()[varname] = assignment.substr(eq + 1);
+  return 0;
+}
+
+static int runDeclare(const vector<string>& args) {
+  if (args.size() > 1 && args[1] == "-p") return args.size() > 2 ? runDeclareShow(args[2]) : 0;
+  if (args.size() > 1) return runDeclareSet(args[1]);
+  return 0;
+}
+
+static int runHashList() {
+  vector<HashEntry> entries = hashEntries();
+  if (entries.empty()) { cout << "hash: hash table empty\n"; return 0; }
+  cout << "hits\tcommand\n";
+  for (const auto& entry : entries) {
+    string hits = to_string(entry.hits);
+    if (hits.size() < 4) hits.insert(0, 4 - hits.size(), ' ');
+    cout << hits << "\t" << entry.path << '\n';
+  }
+  return 0;
+}
+
+static int runHash(const vector<string>& args) {
+  if (args.size() == 1) return runHashList();
+  size_t i = 1;
+  for (; i < args.size() && args[i].starts_with('-'); ++i) {
+    if (args[i] == "-r") { hashClear(); continue; }
+    if (args[i] == "-p" && i + 2 < args.size()) { hashInsert(args[i + 2], args[i + 1]); return 0; }
+    cerr << "hash: " << args[i] << ": invalid option" << endl;
+    cerr << "hash: usage: hash [-r] [-p pathname] [name ...]" << endl;
+    return 2;
+  }
+  int status = 0;
+  for (; i < args.size(); ++i) {
+    if (hashLookup(args[i]).empty()) { cerr << "hash: " << args[i] << ": not found" << endl; status = 1; }
+  }
+  return status;
+}
+
+static int runCd(const vector<string>& args) {
+  if (args.size() <= 1) return 0;
+  string path = args[1];
+  if (path == "~" || path.starts_with("~/")) {
+    const char* home_env = getenv("HOME");
+    if (home_env) {
+      string home = home_env;
+      path = (path == "~") ? home : home + path.substr(1);
+    }
+  }
+  if (chdir(path.c_str()) != 0) {
+    cout << "cd: " << path << ": No such file or directory\n";
+    return 1;
+  }
+  return 0;
+}
+
+namespace {
+
+constexpr array<pair<string_view, bool ShellOptions::*>, 3> kOptions = {{
+  {"monitor",    &ShellOptions::monitor},
+  {"pipefail",   &ShellOptions::pipefail},
+  {"trace-perf", &ShellOptions::trace_perf},
+}};
+
+} // namespace
+
+static int runSetList(bool as_commands) {
+  for (const auto& [name, member] : kOptions) {
+    bool on = shell_options().*member;
+    if (as_commands) cout << "set " << (on ? '-' : '+') << "o " << name << '\n';
+    else             cout << left << setw(15) << name << (on ? "on" : "off") << '\n';
+  }
+  return 0;
+}
+
+static int runSet(const vector<string>& args) {
+  if (args.size() == 2 && (args[1] == "-o" || args[1] == "+o")) return runSetList(args[1] == "+o");
+  for (size_t i = 1; i < args.size(); ++i) {
+    if ((args[i] != "-o" && args[i] != "+o") || i + 1 >= args.size()) {
+      cerr << "set: " << args[i] << ": invalid option" << endl;
+      cerr << "set: usage: set [-o|+o] [option-name]" << endl;
+      return 2;
+    }
+    const string& name = args[i + 1];
+    auto it = ranges::find(kOptions, string_view(name), &pair<string_view, bool ShellOptions::*>::first);
+    if (it == kOptions.end()) { cerr << "set: " << name << ": invalid option name" << endl; return 2; }
+    shell_options().*(it->second) = args[i] == "-o";
+    if (it->second == &ShellOptions::trace_perf && args[i] == "+o") traceDump();
+    ++i;
+  }
+  return 0;
+}
+
+static int runTimes(const vector<string>&) {
+  rusage self;
+  rusage children;
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_CHILDREN, &children);
+  cout << formatMinSec(toSeconds(self.ru_utime)) << ' ' << formatMinSec(toSeconds(self.ru_stime)) << '\n'
+       << formatMinSec(toSeconds(children.ru_utime)) << ' ' << formatMinSec(toSeconds(children.ru_stime)) << '\n';
+  return 0;
+}
+
+static void printLimit(const LimitResource& res, bool hard, bool labelled) {
+  rlimit limit;
+  getrlimit(res.resource, &limit);
+  if (labelled) {
+    string flag = "(" + (res.unit.empty() ? string() : string(res.unit) + ", ") + "-" + res.option + ")";
+    cout << left << setw(20) << res.description << right << setw(16) << flag << ' ';
+  }
+  cout << formatLimit(hard ? limit.rlim_max : limit.rlim_cur, res) << '\n';
+}
+
+static int runUlimit(const vector<string>& args) {
+  size_t pos = 1;
+  LimitRequest req;
+  if (!parseLimitArgs(args, pos, req)) return 2;
+  if (pos < args.size()) {
+    cerr << "ulimit: --: command expected" << endl;
+    return 2;
+  }
+  if (!applyLimits(req.set)) return 1;
+  bool all = req.all || (req.set.empty() && req.show.empty());
+  if (all) {
+    for (const auto& res : limitResources()) printLimit(res, req.hard, true);
+    return 0;
+  }
+  for (const LimitResource* res : req.show) printLimit(*res, req.hard, req.show.size() > 1);
+  return 0;
+}
+
+namespace {
+
+/**
+ * One row of the built-in table.  The table is the single source of truth
+ * for built-in names: dispatch, `type`, and tab completion all read it.
+ */
+struct BuiltinSpec {
+  string_view name;
+  BuiltinHandler run;
+};
+
+constexpr array<BuiltinSpec, 18> kBuiltins = {{
+  {"echo",     runEcho},
+  {"exit",     runExit},
+  {"type",     runType},
+  {"pwd",      runPwd},
+  {"cd",       runCd},
+  {"history",  runHistory},
+  {"jobs",     runJobs},
+  {"wait",     runWait},
+  {"fg",       runFg},
+  {"bg",       runBg},
+  {"kill",     runKill},
+  {"disown",   runDisown},
+  {"complete", runComplete},
+  {"declare",  runDeclare},
+  {"hash",     runHash},
+  {"set",      runSet},
+  {"times",    runTimes},
+  {"ulimit",   runUlimit},
+}};
+
+constexpr array<string_view, kBuiltins.size()> kBuiltinNames = [] {
+  array<string_view, kBuiltins.size()> names{};
+  for (size_t i = 0; i < kBuiltins.size(); ++i) names[i] = kBuiltins[i].name;
+  return names;
+}();
+
+// Perfect hash: FNV-1a with a seed searched at compile time so that every
+// built-in name lands in its own slot.  A lookup is one hash plus at most
+// one string comparison.
+constexpr size_t kSlotCount = 32;
+static_assert((kSlotCount & (kSlotCount - 1)) == 0 && kBuiltins.size() <= kSlotCount);
+
+constexpr size_t slotOf(string_view name, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed;
+  for (char c : name) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 16777619u;
+  }
+  // The multiply only carries upwards, so fold the seed-dependent high
+  // bits down before masking.
+  return (h ^ (h >> 16)) & (kSlotCount - 1);
+}
+
+consteval uint32_t findSeed() {
+  for (uint32_t seed = 0; seed < 100000; ++seed) {
+    array<bool, kSlotCount> used{};
+    bool collision = false;
+    for (const auto& b : kBuiltins) {
+      size_t slot = slotOf(b.name, seed);
+      collision = collision || used[slot];
+      used[slot] = true;
+    }
+    if (!collision) return seed;
+  }
+  throw "no collision-free seed; grow kSlotCount";
+}
+
+constexpr uint32_t kSeed = findSeed();
+
+constexpr array<int8_t, kSlotCount> kSlots = [] {
+  array<int8_t, kSlotCount> slots{};
+  slots.fill(-1);
+  for (size_t i = 0; i < kBuiltins.size(); ++i)
+    slots[slotOf(kBuiltins[i].name, kSeed)] = static_cast<int8_t>(i);
+  return slots;
+}();
+
+} // namespace
+
+BuiltinHandler findBuiltin(string_view name) {
+  int8_t idx = kSlots[slotOf(name, kSeed)];
+  if (idx < 0 || kBuiltins[idx].name != name) return nullptr;
+  return kBuiltins[idx].run;
+}
+
+bool isBuiltin(string_view cmd) {
+  return findBuiltin(cmd) != nullptr;
+}
+
+span<const string_view> builtinNames() {
+  return kBuiltinNames;
+}
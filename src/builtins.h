@@ -0,0 +1,49 @@
+/**
+ * @file builtins.h
+ * @brief Shell built-in commands.  Built-ins always run inside the shell
+ *        process, including when they appear as pipeline stages.
+ *
+ * Every built-in lives in one constexpr table indexed by a compile-time
+ * perfect hash, so resolving a command name costs one hash and at most one
+ * string comparison on every execution path.
+ */
+#pragma once
+
+#include "globals.h"
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Entry point of a built-in.
+ *
+ * @param[in] args  Tokenized command words; args[0] is the built-in name.
+ * @return          Exit status (0 on success).
+ */
+using BuiltinHandler = int (*)(const std::vector<std::string>& args);
+
+/**
+ * @brief Looks up the handler for @p name.
+ *
+ * @param[in] name  Command name to resolve.
+ * @return          The built-in's handler, or nullptr if @p name is not a
+ *                  built-in.
+ */
+BuiltinHandler findBuiltin(std::string_view name);
+
+/**
+ * @brief Returns true if @p cmd is a recognized shell built-in.
+ *
+ * @param[in] cmd  The command name to check.
+ * @return         true if @p cmd names a built-in, false otherwise.
+ */
+bool isBuiltin(std::string_view cmd);
+
+/**
+ * @brief Names of all built-ins, in table order.
+ *
+ * @return A view over the compile-time name list.
+ */
+std::span<const std::string_view> builtinNames();
@@ -0,0 +1,330 @@
+/**
+ * @file completer.cpp
+ * @brief Implementation of deadline-bound, cached external completers and
+ *        completion servers.
+ */
+#include "completer.h"
+#include "executor.h"
+#include "globals.h"
+#include "launch.h"
+#include "reaper.h"
+#include "timing.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <readline/readline.h>
+
+using namespace std;
+
+namespace {
+
+constexpr double kDefaultTimeout = 1.0;
+
+// Seconds a completer's answer is reused for the same query.
+constexpr double kCacheTtl = 5.0;
+
+// Cached answers kept at most; expired ones are dropped first.
+constexpr size_t kCacheEntries = 64;
+
+struct CachedAnswer {
+  vector<string> candidates;
+  double expires;
+};
+
+enum class Outcome { Done, Timeout, Key, Closed };
+
+/** A running `complete -S` server and the output it has not consumed. */
+struct CompletionServer {
+  pid_t pid = -1;
+  int fd = -1;
+  string buffer;
+  int stale = 0;  // replies still owed to abandoned requests
+};
+
+} // namespace
+
+static unordered_map<string, CachedAnswer>& completerCache() {
+  static unordered_map<string, CachedAnswer> val;
+  return val;
+}
+
+static unordered_map<string, CompletionServer>& completionServers() {
+  static unordered_map<string, CompletionServer> val;
+  return val;
+}
+
+// COMP_TIMEOUT: the shell variable, else the environment; fractional
+// seconds are allowed.
+static double completerTimeout() {
+  string_view value;
+  if (auto it = shell_variables().find("COMP_TIMEOUT"); it != shell_variables().end()) {
+    value = it->second;
+  } else if (const char* env = getenv("COMP_TIMEOUT")) {
+    value = env;
+  }
+  double timeout = 0;
+  auto [end, ec] = from_chars(value.data(), value.data() + value.size(), timeout);
+  if (ec != errc() || end != value.data() + value.size() || !(timeout > 0)) return kDefaultTimeout;
+  return timeout;
+}
+
+static string cacheKey(const CompletionSpec& spec, const CompletionQuery& query) {
+  string key = (spec.server ? "S" : "C") + spec.completer;
+  for (const string* part : {&query.command, &query.prev_word, &query.word}) {
+    key += '\0';
+    key += *part;
+  }
+  return key;
+}
+
+static void remember(string key, const vector<string>& candidates, double now) {
+  auto& cache = completerCache();
+  if (cache.size() >= kCacheEntries) {
+    erase_if(cache, [now](const auto& entry) { return entry.second.expires <= now; });
+    if (cache.size() >= kCacheEntries) cache.erase(cache.begin());
+  }
+  cache.insert_or_assign(move(key), CachedAnswer{candidates, now + kCacheTtl});
+}
+
+static int millisecondsUntil(double deadline) {
+  return static_cast<int>(ceil(max(0.0, deadline - monotonicSeconds()) * 1000));
+}
+
+// Collects the completer's exit before @p deadline; false if it is still
+// running then.  Stops are not exits and are skipped.
+static bool exitedBy(pid_t pid, double deadline) {
+  while (true) {
+    reapChildren();
+    int wstatus;
+    if (claimExit(pid, wstatus) && !WIFSTOPPED(wstatus) && !WIFCONTINUED(wstatus)) return true;
+    int wait_ms = millisecondsUntil(deadline);
+    if (wait_ms == 0) return false;
+    pollfd fd{reaperFd(), POLLIN, 0};
+    if (poll(&fd, 1, wait_ms) == 0) return false;
+  }
+}
+
+// Waits for @p fd to become readable.  A key press on readline's input
+// ends the wait and stays unread for readline.
+static Outcome waitReadable(int fd, double deadline) {
+  int key_fd = fileno(rl_instream ? rl_instream : stdin);
+  pollfd fds[2] = {{fd, POLLIN, 0}, {key_fd, POLLIN, 0}};
+  while (true) {
+    int wait_ms = millisecondsUntil(deadline);
+    if (wait_ms == 0) return Outcome::Timeout;
+    int ready = poll(fds, 2, wait_ms);
+    if (ready == -1 && errno == EINTR) continue;
+    if (ready <= 0) return Outcome::Timeout;
+    if (fds[1].revents) return Outcome::Key;
+    return Outcome::Done;
+  }
+}
+
+// Reads @p fd until EOF.
+static Outcome readToEnd(int fd, double deadline, string& out) {
+  char chunk[4096];
+  while (true) {
+    if (Outcome waited = waitReadable(fd, deadline); waited != Outcome::Done) return waited;
+    ssize_t n = read(fd, chunk, sizeof chunk);
+    if (n == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+    if (n <= 0) return n == 0 ? Outcome::Done : Outcome::Closed;
+    out.append(chunk, n);
+  }
+}
+
+// Splits the registered completer into its words and resolves the program.
+static vector<string> completerArgs(const string& completer, string& path) {
+  vector<string> args;
+  istringstream words(completer);
+  for (string word; words >> word;) args.push_back(word);
+  if (!args.empty()) path = args[0].find('/') != string::npos ? args[0] : findInPath(args[0]);
+  return args;
+}
+
+static bool runProgram(const string& completer, const CompletionQuery& query, double deadline,
+                       vector<string>& out) {
+  string path;
+  vector<string> args = completerArgs(completer, path);
+  if (path.empty()) return false;
+  args.insert(args.end(), {query.command, query.word, query.prev_word});
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) == -1) return false;
+  int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  SpawnIO io;
+  io.stdin_fd = null_fd;
+  io.stdout_fd = fds[1];
+  io.pgid = 0;  // its own group, so a timeout kills whatever it started too
+  io.env = {"COMP_LINE=" + query.line, "COMP_POINT=" + to_string(query.line.size())};
+  pid_t pid = spawnProgram(path, args, io);
+  if (null_fd != -1) close(null_fd);
+  close(fds[1]);
+  if (pid <= 0) { close(fds[0]); return false; }
+
+  string output;
+  Outcome outcome = readToEnd(fds[0], deadline, output);
+  close(fds[0]);
+  if (outcome != Outcome::Done || !exitedBy(pid, deadline)) {
+    kill(-pid, SIGKILL);
+    int wstatus;
+    waitForExit(pid, wstatus);
+    return false;
+  }
+
+  for (size_t pos = 0; pos < output.size();) {
+    size_t nl = output.find('\n', pos);
+    if (nl == string::npos) nl = output.size();
+    if (nl > pos) out.emplace_back(output, pos, nl - pos);
+    pos = nl + 1;
+  }
+  return true;
+}
+
+static bool startServer(const string& completer, CompletionServer& server) {
+  string path;
+  vector<string> args = completerArgs(completer, path);
+  if (path.empty()) return false;
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) return false;
+  SpawnIO io;
+  io.stdin_fd = fds[1];
+  io.stdout_fd = fds[1];
+  io.pgid = 0;
+  pid_t pid = spawnProgram(path, args, io);
+  close(fds[1]);
+  if (pid <= 0) { close(fds[0]); return false; }
+  server = {pid, fds[0], {}, 0};
+  return true;
+}
+
+// Closing the socket asks the server to exit; after @p grace seconds it is
+// killed.
+static void stopServer(CompletionServer& server, double grace) {
+  close(server.fd);
+  if (!exitedBy(server.pid, monotonicSeconds() + grace)) {
+    kill(-server.pid, SIGKILL);
+    int wstatus;
+    waitForExit(server.pid, wstatus);
+  }
+}
+
+static void appendField(string& request, string_view field) {
+  for (char c : field) {
+    if (c == '\\')      request += "\\\\";
+    else if (c == '\t') request += "\\t";
+    else if (c == '\n') request += "\\n";
+    else                request += c;
+  }
+}
+
+static bool sendRequest(const CompletionServer& server, const CompletionQuery& query) {
+  string request;
+  const string point = to_string(query.line.size());
+  for (const string* field : {&query.line, &point, &query.command, &query.word, &query.prev_word}) {
+    if (!request.empty()) request += '\t';
+    appendField(request, *field);
+  }
+  request += '\n';
+  // The socket never holds more than a few requests, so this does not
+  // block; a vanished server surfaces as EPIPE rather than SIGPIPE.
+  for (string_view rest = request; !rest.empty();) {
+    ssize_t n = send(server.fd, rest.data(), rest.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    rest.remove_prefix(n);
+  }
+  return true;
+}
+
+// Reads one reply up to its terminating empty line.  Lines are appended to
+// @p out unless it is null.
+static Outcome readReply(CompletionServer& server, double deadline, vector<string>* out) {
+  char chunk[4096];
+  while (true) {
+    for (size_t nl; (nl = server.buffer.find('\n')) != string::npos;) {
+      if (nl == 0) { server.buffer.erase(0, 1); return Outcome::Done; }
+      if (out) out->emplace_back(server.buffer, 0, nl);
+      server.buffer.erase(0, nl + 1);
+    }
+    if (Outcome waited = waitReadable(server.fd, deadline); waited != Outcome::Done) return waited;
+    ssize_t n = read(server.fd, chunk, sizeof chunk);
+    if (n == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+    if (n <= 0) return Outcome::Closed;
+    server.buffer.append(chunk, n);
+  }
+}
+
+static bool askServer(const string& completer, const CompletionQuery& query, double deadline,
+                      vector<string>& out) {
+  auto& servers = completionServers();
+  auto it = servers.find(completer);
+  if (it == servers.end()) {
+    CompletionServer server;
+    if (!startServer(completer, server)) return false;
+    it = servers.emplace(completer, move(server)).first;
+  }
+  CompletionServer& server = it->second;
+
+  Outcome outcome = Outcome::Done;
+  while (server.stale > 0 && (outcome = readReply(server, deadline, nullptr)) == Outcome::Done)
+    --server.stale;
+  if (outcome == Outcome::Done) {
+    outcome = sendRequest(server, query) ? readReply(server, deadline, &out) : Outcome::Closed;
+    if (outcome == Outcome::Key) ++server.stale;
+  }
+  if (outcome == Outcome::Done) return true;
+  out.clear();
+  // A server that is stuck or gone is replaced on the next request.
+  if (outcome != Outcome::Key) {
+    stopServer(server, 0);
+    servers.erase(it);
+  }
+  return false;
+}
+
+bool runCompleter(const CompletionSpec& spec, const CompletionQuery& query, vector<string>& out) {
+  TraceSpan span("completer", spec.completer);
+  double now = monotonicSeconds();
+  string key = cacheKey(spec, query);
+  if (auto it = completerCache().find(key); it != completerCache().end()) {
+    if (it->second.expires > now) {
+      out = it->second.candidates;
+      return true;
+    }
+    completerCache().erase(it);
+  }
+
+  out.clear();
+  double deadline = now + completerTimeout();
+  bool answered = spec.server ? askServer(spec.completer, query, deadline, out)
+                              : runProgram(spec.completer, query, deadline, out);
+  if (answered) remember(move(key), out, monotonicSeconds());
+  return answered;
+}
+
+void syncCompleters() {
+  completerCache().clear();
+  auto& servers = completionServers();
+  for (auto it = servers.begin(); it != servers.end();) {
+    bool registered = ranges::any_of(completion_registry(), [&](const auto& entry) {
+      return entry.second.server && entry.second.completer == it->first;
+    });
+    if (registered) { ++it; continue; }
+    stopServer(it->second, 0.1);
+    it = servers.erase(it);
+  }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file completer.h
+ * @brief External completers registered with `complete -C` and
+ *        `complete -S`.
+ *
+ * A `-C` completer is spawned directly, without an intermediate shell, as
+ * `program [args...] cmd word prev_word` with COMP_LINE and COMP_POINT in
+ * its environment, and prints one candidate per line.
+ *
+ * A `-S` completer is a server: it is started once, in its own process
+ * group, with a socket as its stdin and stdout, and answers one request
+ * per Tab.  A request is one line of tab-separated fields
+ *
+ *     COMP_LINE  COMP_POINT  cmd  word  prev_word
+ *
+ * in which a backslash, tab or newline inside a field is written as `\\`,
+ * `\t` or `\n`.  The reply is one candidate per line, terminated by an
+ * empty line.  A server that exits is restarted on the next request.
+ *
+ * Either kind is read without blocking against a deadline of COMP_TIMEOUT
+ * seconds (default 1).  A completer still running at the deadline is
+ * killed together with its process group and yields no candidates.  A key
+ * press also abandons the request: a `-C` completer is killed, while a
+ * server is kept and its late reply discarded.  Answers are cached for a
+ * few seconds, keyed by command, previous word and prefix, so repeated Tab
+ * presses do not ask again.
+ */
+#pragma once
+
+#include "globals.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief The word being completed and its context.
+ *
+ * @var CompletionQuery::command    First word of the line.
+ * @var CompletionQuery::word       Word being completed (the prefix).
+ * @var CompletionQuery::prev_word  Word before it.
+ * @var CompletionQuery::line       Line up to the end of @p word (COMP_LINE).
+ */
+struct CompletionQuery {
+  std::string command;
+  std::string word;
+  std::string prev_word;
+  std::string line;
+};
+
+/**
+ * @brief Asks the completer @p spec about @p query, or answers from the
+ *        cache.
+ *
+ * @param[in]  spec   The registered completer.  Its program is looked up
+ *                    on PATH if it has no '/'; words are separated by
+ *                    whitespace.
+ * @param[in]  query  What to complete.
+ * @param[out] out    Receives the non-empty candidate lines.
+ * @return            false if the completer could not be started, timed
+ *                    out or was abandoned for a key press.
+ */
+bool runCompleter(const CompletionSpec& spec, const CompletionQuery& query,
+                  std::vector<std::string>& out);
+
+/**
+ * @brief Call after completion_registry() changes: drops every cached
+ *        answer and stops the servers no longer registered.
+ */
+void syncCompleters();
@@ -3,61 +3,30 @@
  * @brief GNU Readline tab-completion generators and hooks.
  */
 #include "completion.h"
+#include "builtins.h"
+#include "completer.h"
+#include "dircache.h"
 #include "executor.h"
+#include "pathcache.h"
+#include "trace.h"
 
 #include <sstream>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <print>
 #include <span>
 #include <string_view>
 #include <algorithm>
-#include <filesystem>
 #include <readline/history.h>
 
 using namespace std;
-namespace fs = std::filesystem;
 
 vector<string>& getCompleterResults() {
   static vector<string> results;
   return results;
 }
 
-static bool isExecutable(const fs::directory_entry& entry) {
-  using enum fs::perms;
-  auto perms = entry.status().permissions();
-  return (perms & owner_exec) != none ||
-         (perms & group_exec) != none ||
-         (perms & others_exec) != none;
-}
-
-static vector<string> collectPathExecutables(string_view prefix) {
-  vector<string> results;
-  const char* path_env = getenv("PATH");
-  if (!path_env) return results;
-
-  stringstream ss(path_env);
-  string dir_str;
-  while (getline(ss, dir_str, ':')) {
-    fs::path dir(dir_str);
-    if (!fs::exists(dir)) continue;
-    try {
-      for (const auto& entry : fs::directory_iterator(dir)) {
-        if (!entry.is_regular_file()) continue;
-        string filename = entry.path().filename().string();
-        if (!filename.starts_with(prefix)) continue;
-        if (!isExecutable(entry)) continue;
-        if (ranges::find(results, filename) == results.end()) {
-          results.push_back(filename);
-        }
-      }
-    } catch (const fs::filesystem_error&) {
-      // Skip directories that cannot be read (permission denied, broken symlinks, etc.)
-    }
-  }
-  return results;
-}
-
 char* command_generator(const char* text, int state) {
   static int list_index;
   static string search_text;
@@ -70,16 +39,16 @@ char* command_generator(const char* text, int state) {
     list_index = 0;
     path_exec_index = 0;
     builtins_done = false;
-    path_executables = collectPathExecutables(search_text);
+    path_executables = pathExecutables(search_text);
   }
 
   if (!builtins_done) {
-    while (builtin_commands[list_index]) {
-      const char* name = builtin_commands[list_index];
+    span<const string_view> names = builtinNames();
+    while (list_index < (int)names.size()) {
+      string_view name = names[list_index];
       ++list_index;
-      string cmd_name(name);
-      if (cmd_name.starts_with(search_text)) {
-        return strdup(name);
+      if (name.starts_with(search_text)) {
+        return strdup(string(name).c_str());
       }
     }
     builtins_done = true;
@@ -94,54 +63,44 @@ char* command_generator(const char* text, int state) {
   return nullptr;
 }
 
-char* filename_generator(const char* text, int state) {
-  static vector<string> matches;
-  static size_t match_index;
+namespace {
 
-  if (!state) {
-    matches.clear();
-    match_index = 0;
-
-    string input(text ? text : "");
-    string dir_path;
-    string file_prefix;
-    if (size_t last_slash = input.rfind('/'); last_slash != string::npos) {
-      dir_path = input.substr(0, last_slash + 1);
-      file_prefix = input.substr(last_slash + 1);
-    } else {
-      dir_path = "";
-      file_prefix = input;
-    }
+// Most matches handed to readline; the rest are only counted.
+constexpr size_t kMaxMatches = 1000;
 
-    string search_dir = dir_path.empty() ? "." : dir_path;
-
-    try {
-      for (const auto& entry : fs::directory_iterator(search_dir)) {
-        string filename = entry.path().filename().string();
-        if (!filename.starts_with(file_prefix)) continue;
-        string match = dir_path + filename;
-        if (fs::is_directory(entry.status())) {
-          match += "/";
-        }
-        matches.push_back(match);
-      }
-    } catch (const fs::filesystem_error&) {
-      // Skip directories that cannot be iterated (permission denied, etc.)
-    }
-  }
+} // namespace
 
-  if (match_index < matches.size()) {
-    const string& match = matches[match_index];
-    ++match_index;
-    if (!match.empty() && match.back() == '/') {
-      rl_completion_append_character = '\0';
-    } else {
-      rl_completion_append_character = ' ';
-    }
-    return strdup(match.c_str());
-  }
+// Matches found by the last completion, including any beyond kMaxMatches.
+static size_t& matchTotal() {
+  static size_t val = 0;
+  return val;
+}
 
-  return nullptr;
+char** filename_completion(const char* text) {
+  string_view input(text ? text : "");
+  size_t last_slash = input.rfind('/');
+  string dir_path(last_slash == string_view::npos ? "" : input.substr(0, last_slash + 1));
+  string_view file_prefix = input.substr(dir_path.size());
+
+  DirMatches found = matchDirectory(dir_path.empty() ? "." : dir_path, file_prefix, kMaxMatches);
+  matchTotal() = found.total;
+  if (found.total == 0) return nullptr;
+
+  // matches[0] is what replaces the word: the sole match, or the prefix
+  // common to all of them, including those past the cap.
+  auto** matches = static_cast<char**>(malloc((found.shown.size() + 2) * sizeof(char*)));
+  size_t n = 0;
+  if (found.total == 1) {
+    const DirEntry& only = found.shown.front();
+    rl_completion_append_character = only.is_dir ? '\0' : ' ';
+    matches[n++] = strdup((dir_path + only.name + (only.is_dir ? "/" : "")).c_str());
+  } else {
+    matches[n++] = strdup((dir_path + found.common).c_str());
+    for (const DirEntry& entry : found.shown)
+      matches[n++] = strdup((dir_path + entry.name + (entry.is_dir ? "/" : "")).c_str());
+  }
+  matches[n] = nullptr;
+  return matches;
 }
 
 char* completer_generator(const char* /*text*/, int state) {
@@ -159,16 +118,6 @@ char* completer_generator(const char* /*text*/, int state) {
   return nullptr;
 }
 
-static string shell_escape(const string& s) {
-  string out = "'";
-  for (char c : s) {
-    if (c == '\'') out += "'\\''";
-    else           out += c;
-  }
-  out += "'";
-  return out;
-}
-
 static string extractPrevWord(const string& before_cursor) {
   vector<string> tokens;
   istringstream iss(before_cursor);
@@ -182,19 +131,9 @@ static string extractPrevWord(const string& before_cursor) {
   return {};
 }
 
-static void runCompletionScript(const string& invoke) {
-  FILE* fp = popen(invoke.c_str(), "r");
-  if (!fp) return;
-  string buf(4096, '\0');
-  while (fgets(buf.data(), static_cast<int>(buf.size()), fp)) {
-    string out(buf.data());
-    if (!out.empty() && out.back() == '\n') out.pop_back();
-    if (!out.empty()) getCompleterResults().push_back(out);
-  }
-  pclose(fp);
-}
-
 char** command_completion(const char* text, int start, int /*end*/) {
+  TraceSpan span("completion", text);
+  matchTotal() = 0;
   if (start == 0) {
     return rl_completion_matches(text, command_generator);
   }
@@ -204,20 +143,9 @@ char** command_completion(const char* text, int start, int /*end*/) {
   string cmd = (sp != string::npos) ? line.substr(0, sp) : line;
 
   if (auto it = completion_registry().find(cmd); it != completion_registry().end()) {
-    getCompleterResults().clear();
-
     string before_cursor = line.substr(0, start);
-    string prev_word     = extractPrevWord(before_cursor);
-
-    string comp_line  = before_cursor + string(text);
-    string comp_point = to_string(comp_line.size());
-
-    string invoke = "COMP_LINE=" + shell_escape(comp_line) +
-                    " COMP_POINT=" + comp_point +
-                    " " + it->second + " " + shell_escape(cmd) + " " +
-                    shell_escape(string(text)) + " " + shell_escape(prev_word);
-
-    runCompletionScript(invoke);
+    CompletionQuery query{cmd, text, extractPrevWord(before_cursor), before_cursor + text};
+    if (!runCompleter(it->second, query, getCompleterResults())) getCompleterResults().clear();
 
     if (!getCompleterResults().empty()) {
       rl_attempted_completion_over = 1;
@@ -226,11 +154,31 @@ char** command_completion(const char* text, int start, int /*end*/) {
   }
 
   rl_attempted_completion_over = 1;
-  return rl_completion_matches(text, filename_generator);
+  return filename_completion(text);
+}
+
+// Readline's own y/n question before a long listing.
+static bool confirmListing(size_t total) {
+  std::print(rl_outstream, "\nDisplay all {} possibilities? (y or n)", total);
+  fflush(rl_outstream);
+  while (true) {
+    int c = rl_read_key();
+    if (c == 'y' || c == 'Y' || c == ' ') return true;
+    if (c == 'n' || c == 'N' || c == RUBOUT || c == EOF) return false;
+    rl_ding();
+  }
 }
 
 void display_matches_hook(char** matches, int num_matches, int /*max_length*/) {
   span<char*> match_list(matches + 1, static_cast<size_t>(num_matches));
+  size_t total = max(matchTotal(), match_list.size());
+  if (rl_completion_query_items > 0 && total >= static_cast<size_t>(rl_completion_query_items) &&
+      !confirmListing(total)) {
+    std::print(rl_outstream, "\n");
+    rl_on_new_line();
+    rl_redisplay();
+    return;
+  }
   std::print(rl_outstream, "\n");
   bool first = true;
   for (const char* m : match_list) {
@@ -238,6 +186,7 @@ void display_matches_hook(char** matches, int num_matches, int /*max_length*/) {
     first = false;
     std::print(rl_outstream, "{}", m);
   }
+  if (total > match_list.size()) std::print(rl_outstream, "\n({} more not shown)", total - match_list.size());
   std::print(rl_outstream, "\n");
   rl_on_new_line();
   rl_redisplay();
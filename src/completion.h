@@ -32,18 +32,19 @@ std::vector<std::string>& getCompleterResults();
 char* command_generator(const char* text, int state);
 
 /**
- * @brief Readline generator for filesystem path tab completion.
+ * @brief Filesystem path tab completion.
  *
- * Enumerates files and directories whose names begin with the basename of
- * @p text, prefixed by the directory part of @p text.  Directories are
- * returned with a trailing '/'.  Conforms to the readline generator protocol.
+ * Matches the basename of @p text against the cached, sorted listing of
+ * its directory (see dircache.h) and prefixes each match with the
+ * directory part of @p text.  Directories carry a trailing '/'.  At most
+ * 1000 matches are returned, in byte order; the common prefix and the
+ * count reported by display_matches_hook() cover all of them.
  *
- * @param[in] text   Path prefix typed so far.
- * @param[in] state  0 on the first call; non-zero on subsequent calls.
- * @return           Heap-allocated matching path (caller must free), or
- *                   nullptr when all matches are exhausted.
+ * @param[in] text  Path prefix typed so far.
+ * @return          Heap-allocated match array in the format of
+ *                  rl_completion_matches(), or nullptr if nothing matches.
  */
-char* filename_generator(const char* text, int state);
+char** filename_completion(const char* text);
 
 /**
  * @brief Readline generator that drains completer_results one entry at a time.
@@ -63,9 +64,9 @@ char* completer_generator(const char* text, int state);
  *
  * - When @p start == 0 (completing the command word), delegates to command_generator.
  * - Otherwise looks up the command word in completion_registry; if a script is
- *   registered, invokes it with COMP_LINE/COMP_POINT and uses completer_generator
- *   to return its output.
- * - Falls back to filename_generator for unregistered commands.
+ *   registered, runs it through runCompleter() (see completer.h) and uses
+ *   completer_generator to return its output.
+ * - Falls back to filename_completion for unregistered commands.
  *
  * @param[in] text   Word being completed.
  * @param[in] start  Byte offset of @p text in rl_line_buffer.
@@ -80,7 +81,9 @@ char** command_completion(const char* text, int start, int end);
  *        redraws the prompt.  Registered via rl_completion_display_matches_hook.
  *
  * Prints all matches space-separated on one line instead of readline's default
- * columnar layout, then redraws the current input line.
+ * columnar layout, then redraws the current input line.  When there are at
+ * least rl_completion_query_items matches (readline's completion-query-items,
+ * 100 by default) it first asks "Display all N possibilities? (y or n)".
  *
  * @param[in] matches      Null-terminated array; matches[0] is the common prefix,
  *                         candidates begin at matches[1].
@@ -0,0 +1,136 @@
+/**
+ * @file dircache.cpp
+ * @brief Implementation of the cached, getdents64-based directory listings.
+ */
+#include "dircache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Directories whose listings are kept; the least recently used goes first.
+constexpr size_t kCachedDirectories = 8;
+
+// getdents64() batch size: a 200k-entry directory takes ~50 calls.
+constexpr size_t kBatchBytes = 256 * 1024;
+
+/** Record layout returned by the getdents64 system call. */
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+struct Listing {
+  dev_t dev;
+  ino_t ino;
+  timespec mtime;
+  // Read in the same second the directory last changed: a later change in
+  // that second would leave the mtime as it is, so the listing is redone.
+  bool racy;
+  uint64_t last_used;
+  vector<DirEntry> entries;  // sorted by name
+};
+
+} // namespace
+
+static unordered_map<string, Listing>& listings() {
+  static unordered_map<string, Listing> val;
+  return val;
+}
+
+static bool isDotOrDotDot(const char* name) {
+  return name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]));
+}
+
+static bool readListing(int fd, vector<DirEntry>& entries) {
+  auto buf = make_unique_for_overwrite<char[]>(kBatchBytes);
+  while (true) {
+    long n = syscall(SYS_getdents64, fd, buf.get(), kBatchBytes);
+    if (n == -1 && errno == EINTR) continue;
+    if (n < 0) return false;
+    if (n == 0) return true;
+    for (long pos = 0; pos < n;) {
+      const auto* entry = reinterpret_cast<const LinuxDirent64*>(buf.get() + pos);
+      pos += entry->d_reclen;
+      if (isDotOrDotDot(entry->d_name)) continue;
+      bool is_dir = entry->d_type == DT_DIR;
+      if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+        struct stat st;
+        is_dir = fstatat(fd, entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+      }
+      entries.push_back({entry->d_name, is_dir});
+    }
+  }
+}
+
+static void evictLeastRecent() {
+  auto& cache = listings();
+  auto oldest = ranges::min_element(cache, {}, [](const auto& entry) { return entry.second.last_used; });
+  if (oldest != cache.end()) cache.erase(oldest);
+}
+
+// The listing of @p dir, re-read if the directory has changed since.
+static const Listing* currentListing(const string& dir) {
+  static uint64_t uses = 0;
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0) { close(fd); return nullptr; }
+
+  auto& cache = listings();
+  auto it = cache.find(dir);
+  if (it != cache.end() && !it->second.racy && it->second.dev == st.st_dev &&
+      it->second.ino == st.st_ino && it->second.mtime.tv_sec == st.st_mtim.tv_sec &&
+      it->second.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+    close(fd);
+    it->second.last_used = ++uses;
+    return &it->second;
+  }
+
+  Listing listing{st.st_dev, st.st_ino, st.st_mtim, st.st_mtim.tv_sec >= time(nullptr), 0, {}};
+  bool read_ok = readListing(fd, listing.entries);
+  close(fd);
+  if (!read_ok) return nullptr;
+  ranges::sort(listing.entries, {}, &DirEntry::name);
+
+  if (it == cache.end() && cache.size() >= kCachedDirectories) evictLeastRecent();
+  listing.last_used = ++uses;
+  return &cache.insert_or_assign(dir, move(listing)).first->second;
+}
+
+DirMatches matchDirectory(const string& dir, string_view prefix, size_t limit) {
+  DirMatches out;
+  const Listing* listing = currentListing(dir);
+  if (!listing) return out;
+
+  const auto& entries = listing->entries;
+  auto first = ranges::lower_bound(entries, prefix, {}, &DirEntry::name);
+  auto last = ranges::partition_point(first, entries.end(), [&](const DirEntry& entry) {
+    return entry.name.starts_with(prefix);
+  });
+  out.total = static_cast<size_t>(last - first);
+  if (out.total == 0) return out;
+  out.shown.assign(first, first + min(limit, out.total));
+
+  // Sorted, so what the first and last matches share is shared by all.
+  const string& low = first->name;
+  const string& high = prev(last)->name;
+  auto [mismatch, ignored] = ranges::mismatch(low, high);
+  out.common.assign(low.begin(), mismatch);
+  return out;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file dircache.h
+ * @brief Cached directory listings behind filename completion.
+ *
+ * A directory is read with getdents64() in large batches, and whether an
+ * entry is a directory comes from its d_type; only entries the file
+ * system reports as DT_UNKNOWN, and symlinks, which may point at a
+ * directory, cost a stat.  The sorted listing is kept for the few most
+ * recently completed directories and reused until the directory's mtime
+ * changes, so completing in a directory of 200k files reads it once.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief One directory entry.
+ *
+ * @var DirEntry::name    File name.
+ * @var DirEntry::is_dir  Directory, or a symlink to one.
+ */
+struct DirEntry {
+  std::string name;
+  bool is_dir;
+};
+
+/**
+ * @brief The entries of a directory that start with a prefix.
+ *
+ * @var DirMatches::shown   The first matches in byte order, at most the
+ *                          requested limit.
+ * @var DirMatches::total   Number of matches, including those not shown.
+ * @var DirMatches::common  Longest prefix shared by every match.
+ */
+struct DirMatches {
+  std::vector<DirEntry> shown;
+  size_t total = 0;
+  std::string common;
+};
+
+/**
+ * @brief Looks up the entries of @p dir beginning with @p prefix, reading
+ *        the directory only if its cached listing is missing or stale.
+ *        `.` and `..` are never listed.
+ *
+ * @param[in] dir     Directory path; "." for the working directory.
+ * @param[in] prefix  Leading part of the names wanted.
+ * @param[in] limit   Maximum number of matches returned in DirMatches::shown.
+ * @return            The matches; none if @p dir cannot be read.
+ */
+DirMatches matchDirectory(const std::string& dir, std::string_view prefix, size_t limit);
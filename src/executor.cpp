@@ -4,285 +4,396 @@
  *        program/pipeline running.
  */
 #include "executor.h"
+#include "builtins.h"
+#include "jobs.h"
+#include "launch.h"
+#include "pathcache.h"
+#include "reaper.h"
+#include "timing.h"
+#include "trace.h"
 
 #include <iostream>
-#include <sstream>
-#include <fstream>
-#include <filesystem>
-#include <algorithm>
+#include <array>
+#include <csignal>
+#include <streambuf>
 #include <string_view>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <cerrno>
-#include <readline/history.h>
 
 using namespace std;
-namespace fs = std::filesystem;
 
-bool isBuiltin(string_view cmd) {
-  return cmd == "exit" || cmd == "echo" || cmd == "type" || cmd == "pwd"
-      || cmd == "cd"   || cmd == "history" || cmd == "jobs" || cmd == "complete"
-      || cmd == "declare";
-}
+namespace {
 
-string findInPath(string_view program) {
-  const char* path_env = getenv("PATH");
-  if (!path_env) return "";
-  stringstream ss(path_env);
-  string dir;
-  while (getline(ss, dir, ':')) {
-    fs::path full_path = fs::path(dir) / program;
-    if (fs::exists(full_path) &&
-        (fs::status(full_path).permissions() & fs::perms::owner_exec) != fs::perms::none) {
-      return full_path.string();
+/**
+ * Buffered streambuf that writes straight to a file descriptor.  Once a
+ * write fails (typically EPIPE after the reader exited) further output is
+ * discarded.
+ */
+class FdStreamBuf : public streambuf {
+public:
+  explicit FdStreamBuf(int fd) : fd_(fd) { setp(buf_.data(), buf_.data() + buf_.size()); }
+  FdStreamBuf(const FdStreamBuf&) = delete;
+  FdStreamBuf& operator=(const FdStreamBuf&) = delete;
+
+protected:
+  int_type overflow(int_type ch) override {
+    if (flushBuffer() == -1) return traits_type::eof();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
     }
+    return traits_type::not_eof(ch);
   }
-  return "";
-}
 
-static void builtinEcho(const vector<string>& args) {
-  for (size_t i = 1; i < args.size(); ++i) {
-    if (i > 1) cout << " ";
-    cout << args[i];
+  int sync() override { return flushBuffer(); }
+
+private:
+  int flushBuffer() {
+    const char* p = pbase();
+    bool ok = !broken_;
+    while (ok && p < pptr()) {
+      ssize_t n = write(fd_, p, pptr() - p);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) ok = false;
+      else        p += n;
+    }
+    setp(buf_.data(), buf_.data() + buf_.size());
+    broken_ = !ok;
+    return ok ? 0 : -1;
   }
-  cout << endl;
-}
 
-static void builtinType(const vector<string>& args) {
-  if (args.size() <= 1) return;
-  const string& arg = args[1];
-  if (isBuiltin(arg)) {
-    cout << arg << " is a shell builtin" << endl;
-  } else if (string path = findInPath(arg); !path.empty()) {
-    cout << arg << " is " << path << endl;
-  } else {
-    cout << arg << ": not found" << endl;
+  int fd_;
+  bool broken_ = false;
+  array<char, 65536> buf_;
+};
+
+/**
+ * Points std::cout at a buffered writer on @p fd for the lifetime of the
+ * object, with SIGPIPE blocked so a vanished reader surfaces as EPIPE
+ * instead of killing the shell.
+ */
+class BuiltinOutput {
+public:
+  explicit BuiltinOutput(int fd) : buf_(fd) {
+    cout.flush();
+    sigset_t pipe_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &saved_mask_);
+    saved_buf_ = cout.rdbuf(&buf_);
+    saved_flags_ = cout.flags();
+    cout.unsetf(ios::unitbuf);
   }
-}
 
-static void builtinPwd() {
-  try {
-    cout << fs::current_path().string() << endl;
-  } catch (const fs::filesystem_error&) {
-    cerr << "pwd: error getting current directory" << endl;
+  ~BuiltinOutput() {
+    cout.flush();
+    cout.rdbuf(saved_buf_);
+    cout.flags(saved_flags_);
+    cout.clear();
+    sigset_t pipe_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    timespec no_wait{0, 0};
+    while (sigtimedwait(&pipe_set, nullptr, &no_wait) > 0) {}
+    pthread_sigmask(SIG_SETMASK, &saved_mask_, nullptr);
   }
+
+  BuiltinOutput(const BuiltinOutput&) = delete;
+  BuiltinOutput& operator=(const BuiltinOutput&) = delete;
+
+private:
+  FdStreamBuf buf_;
+  streambuf* saved_buf_;
+  ios::fmtflags saved_flags_;
+  sigset_t saved_mask_;
+};
+
+} // namespace
+
+string findInPath(string_view program) {
+  TraceSpan span("findInPath", program);
+  return hashLookup(program);
 }
 
-static void builtinCd(const vector<string>& args) {
-  if (args.size() <= 1) return;
-  string path = args[1];
-  if (path == "~" || path.starts_with("~/")) {
-    const char* home_env = getenv("HOME");
-    if (home_env) {
-      string home(home_env);
-      path = (path == "~") ? home : home + path.substr(1);
-    }
-  }
-  if (chdir(path.c_str()) != 0) {
-    cout << "cd: " << path << ": No such file or directory" << endl;
-  }
+vector<pid_t>& stopped_stages() {
+  static vector<pid_t> val;
+  return val;
 }
 
-static void historyRead(const string& filename) {
-  ifstream file(filename);
-  if (!file.is_open()) {
-    cerr << "history: " << filename << ": No such file or directory" << endl;
-    return;
-  }
-  string line;
-  while (getline(file, line)) {
-    if (!line.empty()) add_history(line.c_str());
-  }
+int waitForChild(pid_t pid, rusage* usage) {
+  int wstatus;
+  if (!waitForExit(pid, wstatus, usage)) return 0;
+  if (WIFSTOPPED(wstatus)) stopped_stages().push_back(pid);
+  return exitStatusOf(wstatus);
 }
 
-static void historyWrite(const string& filename) {
-  ofstream file(filename);
-  if (!file.is_open()) {
-    cerr << "history: " << filename << ": cannot create" << endl;
-    return;
-  }
-  int end = history_base + history_length;
-  for (int i = history_base; i < end; ++i) {
-    if (const HIST_ENTRY* entry = history_get(i)) file << entry->line << endl;
-  }
+// Foreground process group for a new job: the child leads its own group
+// and takes the terminal, or stays in the shell's group without job control.
+static void foregroundGroup(SpawnIO& io) {
+  if (!shell_options().monitor) return;
+  io.pgid = 0;
+  io.tty_fd = foregroundTty();
 }
 
-static void historyAppend(const string& filename) {
-  ofstream file(filename, ios::app);
-  if (!file.is_open()) {
-    cerr << "history: " << filename << ": cannot create" << endl;
-    return;
-  }
-  int start = (last_appended_index() == -1) ? history_base : last_appended_index() + 1;
-  int end = history_base + history_length;
-  for (int i = start; i < end; ++i) {
-    if (const HIST_ENTRY* entry = history_get(i)) file << entry->line << endl;
-  }
-  last_appended_index() = end - 1;
+int executeProgram(const string& path, const vector<string>& args,
+                   const string& output_file, bool is_append,
+                   const string& error_file, bool is_error_append,
+                   const vector<ResourceLimit>& limits) {
+  SpawnIO io;
+  io.output_file = output_file;
+  io.is_append = is_append;
+  io.error_file = error_file;
+  io.is_error_append = is_error_append;
+  io.limits = limits;
+  foregroundGroup(io);
+  stopped_stages().clear();
+  double start = monotonicSeconds();
+  pid_t pid = spawnProgram(path, args, io);
+  stage_usage().assign(1, StageUsage{args[0], pid, 0, {}});
+  if (pid <= 0) return 127;
+  if (io.pgid == 0) giveTerminalTo(pid);
+  int status = waitForChild(pid, &stage_usage()[0].usage);
+  stage_usage()[0].real = monotonicSeconds() - start;
+  if (io.pgid == 0) reclaimTerminal();
+  return status;
 }
 
-static void historyList(const vector<string>& args) {
-  int start = history_base;
-  int end = history_base + history_length;
-  if (args.size() > 1 && args[1] != "-r" && args[1] != "-w") {
-    int n = stoi(args[1]);
-    start = max(history_base, end - n);
-  }
-  for (int i = start; i < end; ++i) {
-    if (const HIST_ENTRY* entry = history_get(i)) cout << "    " << i << "  " << entry->line << endl;
+static int measureBuiltin(BuiltinHandler run, const vector<string>& args, StageUsage& stage) {
+  rusage before;
+  rusage after;
+  double start = monotonicSeconds();
+  getrusage(RUSAGE_SELF, &before);
+  int status = run(args);
+  getrusage(RUSAGE_SELF, &after);
+  stage = {args.empty() ? string() : args[0], 0, monotonicSeconds() - start, rusageDelta(before, after)};
+  return status;
+}
+
+int executeBuiltin(BuiltinHandler run, const vector<string>& args) {
+  stage_usage().resize(1);
+  return measureBuiltin(run, args, stage_usage()[0]);
+}
+
+static void closePipes(vector<vector<int>>& pipes) {
+  for (auto& p : pipes) {
+    for (int& fd : p) {
+      if (fd != -1) close(fd);
+      fd = -1;
+    }
   }
 }
 
-static void builtinHistory(const vector<string>& args) {
-  if (args.size() > 2 && args[1] == "-r")     { historyRead(args[2]); }
-  else if (args.size() > 2 && args[1] == "-w") { historyWrite(args[2]); }
-  else if (args.size() > 2 && args[1] == "-a") { historyAppend(args[2]); }
-  else                                          { historyList(args); }
+static void closePipeEnd(int& fd) {
+  if (fd != -1) close(fd);
+  fd = -1;
 }
 
-[[noreturn]] void executeBuiltinInChild(const vector<string>& args) {
-  if (const string& program = args[0]; program == "exit")         { exit(0); }
-  else if (program == "echo")    { builtinEcho(args); }
-  else if (program == "type")    { builtinType(args); }
-  else if (program == "pwd")     { builtinPwd(); }
-  else if (program == "cd")      { builtinCd(args); }
-  else if (program == "history") { builtinHistory(args); }
-  exit(0);
+static int runBuiltinStage(int i, int num_commands, const CommandInfo& cmd,
+                           BuiltinHandler run, int pipe_out, StageUsage& stage) {
+  CommandInfo redirects = cmd;
+  if (i < num_commands - 1) redirects.has_redirect = false;
+
+  int saved_stdout = -1;
+  int redirect_fd = -1;
+  int saved_stderr = -1;
+  int error_redirect_fd = -1;
+  setupBuiltinRedirects(redirects, saved_stdout, redirect_fd, saved_stderr, error_redirect_fd);
+  bool was_exiting = exit_requested();
+  int status;
+  {
+    BuiltinOutput output(i < num_commands - 1 ? pipe_out : STDOUT_FILENO);
+    status = measureBuiltin(run, cmd.args, stage);
+  }
+  exit_requested() = was_exiting;  // as in bash, `exit` in a pipeline does not end the shell
+  restoreBuiltinRedirects(saved_stdout, redirect_fd, saved_stderr, error_redirect_fd);
+  return status;
 }
 
-static vector<char*> buildArgv(const vector<string>& args, vector<vector<char>>& storage) {
-  storage.reserve(args.size());
-  vector<char*> argv;
-  argv.reserve(args.size() + 1);
-  for (const auto& arg : args) {
-    storage.emplace_back(arg.begin(), arg.end());
-    storage.back().push_back('\0');
-    argv.push_back(storage.back().data());
+static pid_t spawnPipelineStage(int i, int num_commands,
+                                const vector<vector<int>>& pipes,
+                                const CommandInfo& cmd, const string& path,
+                                pid_t pgid, int tty_fd) {
+  SpawnIO io;
+  io.pgid = pgid;
+  io.tty_fd = pgid == 0 ? tty_fd : -1;
+  if (i > 0) io.stdin_fd = pipes[i - 1][0];
+  if (i < num_commands - 1) io.stdout_fd = pipes[i][1];
+  if (i == num_commands - 1 && cmd.has_redirect) {
+    io.output_file = cmd.output_file;
+    io.is_append = cmd.is_append;
+  }
+  if (cmd.has_error_redirect) {
+    io.error_file = cmd.error_file;
+    io.is_error_append = cmd.is_error_append;
   }
-  argv.push_back(nullptr);
-  return argv;
+  io.limits = cmd.limits;
+  return spawnProgram(path, cmd.args, io);
 }
 
-void executeProgram(const string& path, const vector<string>& args,
-                    const string& output_file, bool is_append,
-                    const string& error_file, bool is_error_append) {
-  pid_t pid = fork();
-  if (pid == 0) {
-    if (!output_file.empty()) {
-      int flags = O_WRONLY | O_CREAT | (is_append ? O_APPEND : O_TRUNC);
-      int fd = open(output_file.c_str(), flags, 0666);
-      if (fd == -1) { cerr << "Failed to open " << output_file << " for writing" << endl; exit(1); }
-      dup2(fd, STDOUT_FILENO);
-      close(fd);
-    }
-    if (!error_file.empty()) {
-      int flags = O_WRONLY | O_CREAT | (is_error_append ? O_APPEND : O_TRUNC);
-      int fd = open(error_file.c_str(), flags, 0666);
-      if (fd == -1) { cerr << "Failed to open " << error_file << " for writing" << endl; exit(1); }
-      dup2(fd, STDERR_FILENO);
-      close(fd);
+// A stage of redirections alone: they are set up like a built-in's, and
+// nothing runs.
+static int redirectsOnly(const vector<string>&) {
+  return 0;
+}
+
+// Resolves every stage up front so a missing command is reported before
+// anything starts.  Returns the index of the first unknown command, or -1.
+static int resolveStages(const vector<CommandInfo>& commands,
+                         vector<string>& paths, vector<BuiltinHandler>& builtins) {
+  paths.assign(commands.size(), "");
+  builtins.assign(commands.size(), nullptr);
+  for (size_t i = 0; i < commands.size(); ++i) {
+    if (commands[i].args.empty()) { builtins[i] = redirectsOnly; continue; }
+    const string& name = commands[i].args[0];
+    if ((builtins[i] = findBuiltin(name))) continue;
+    paths[i] = findInPath(name);
+    if (paths[i].empty()) {
+      cerr << name << ": command not found" << endl;
+      return (int)i;
     }
-    vector<vector<char>> argv_storage;
-    auto argv = buildArgv(args, argv_storage);
-    execv(path.c_str(), argv.data());
-    cerr << "Failed to execute " << path << endl;
-    exit(1);
-  } else if (pid > 0) {
-    int status;
-    waitpid(pid, &status, 0);
-  } else {
-    cerr << "Fork failed" << endl;
   }
+  return -1;
 }
 
-static void closePipes(const vector<vector<int>>& pipes) {
-  for (const auto& p : pipes) {
-    close(p[0]);
-    close(p[1]);
+static bool openPipes(vector<vector<int>>& pipes) {
+  for (auto& p : pipes) {
+    if (pipe2(p.data(), O_CLOEXEC) == -1) {
+      cerr << "Pipe creation failed" << endl;
+      closePipes(pipes);
+      return false;
+    }
   }
+  return true;
 }
 
-[[noreturn]] static void runPipelineChild(int i, int num_commands,
-                                           const vector<vector<int>>& pipes,
-                                           const CommandInfo& cmd,
-                                           const string& path, bool builtin) {
-  if (i > 0) dup2(pipes[i - 1][0], STDIN_FILENO);
-  if (i < num_commands - 1) dup2(pipes[i][1], STDOUT_FILENO);
-  closePipes(pipes);
+int executePipeline(const vector<CommandInfo>& commands) {
+  if (commands.empty()) return 0;
 
-  if (i == num_commands - 1 && cmd.has_redirect && !cmd.output_file.empty()) {
-    int flags = O_WRONLY | O_CREAT | (cmd.is_append ? O_APPEND : O_TRUNC);
-    int fd = open(cmd.output_file.c_str(), flags, 0666);
-    if (fd == -1) { cerr << "Failed to open " << cmd.output_file << " for writing" << endl; exit(1); }
-    dup2(fd, STDOUT_FILENO);
-    close(fd);
+  auto num_commands = (int)commands.size();
+  vector<string> paths;
+  vector<BuiltinHandler> builtins;
+  if (int missing = resolveStages(commands, paths, builtins); missing != -1) {
+    pipe_status().assign(num_commands, 0);
+    pipe_status()[missing] = 127;
+    return 127;
   }
 
-  if (cmd.has_error_redirect && !cmd.error_file.empty()) {
-    int flags = O_WRONLY | O_CREAT | (cmd.is_error_append ? O_APPEND : O_TRUNC);
-    int fd = open(cmd.error_file.c_str(), flags, 0666);
-    if (fd == -1) { cerr << "Failed to open " << cmd.error_file << " for writing" << endl; exit(1); }
-    dup2(fd, STDERR_FILENO);
-    close(fd);
-  }
+  vector<vector<int>> pipes(num_commands - 1, vector<int>(2, -1));
+  if (!openPipes(pipes)) return 1;
 
-  if (builtin) {
-    executeBuiltinInChild(cmd.args);
+  // External stages start first so every built-in has a live reader.
+  double start = monotonicSeconds();
+  vector<StageUsage>& usage = stage_usage();
+  usage.assign(num_commands, StageUsage{});
+  vector<pid_t> pids(num_commands, -1);
+  vector<int> statuses(num_commands, 0);
+  SpawnIO group;
+  foregroundGroup(group);
+  stopped_stages().clear();
+  for (int i = 0; i < num_commands; ++i) {
+    if (!commands[i].args.empty()) usage[i].command = commands[i].args[0];
+    if (builtins[i]) continue;
+    pids[i] = usage[i].pid = spawnPipelineStage(i, num_commands, pipes, commands[i], paths[i],
+                                                group.pgid, group.tty_fd);
+    if (pids[i] <= 0) statuses[i] = 127;
+    else if (group.pgid == 0) giveTerminalTo(group.pgid = pids[i]);
   }
-  vector<vector<char>> argv_storage;
-  auto argv = buildArgv(cmd.args, argv_storage);
-  execv(path.c_str(), argv.data());
-  cerr << "Failed to execute " << path << endl;
-  exit(1);
-}
-
-void executePipeline(const vector<CommandInfo>& commands) {
-  if (commands.empty()) return;
 
-  auto num_commands = (int)commands.size();
-  vector<vector<int>> pipes(num_commands - 1, vector<int>(2));
-  for (int i = 0; i < num_commands - 1; ++i) {
-    if (pipe(pipes[i].data()) == -1) {
-      cerr << "Pipe creation failed" << endl;
-      return;
-    }
+  // Built-ins never read stdin; closing the pipe that feeds one lets its
+  // writer see EPIPE rather than block once the pipe fills.
+  for (int i = 1; i < num_commands; ++i) {
+    if (builtins[i]) closePipeEnd(pipes[i - 1][0]);
+  }
+  for (int i = 0; i < num_commands; ++i) {
+    if (!builtins[i]) continue;
+    int pipe_out = i < num_commands - 1 ? pipes[i][1] : -1;
+    statuses[i] = runBuiltinStage(i, num_commands, commands[i], builtins[i], pipe_out, usage[i]);
+    if (i < num_commands - 1) closePipeEnd(pipes[i][1]);
   }
 
-  vector<pid_t> pids;
+  closePipes(pipes);
   for (int i = 0; i < num_commands; ++i) {
-    const CommandInfo& cmd = commands[i];
-    bool builtin = isBuiltin(cmd.args[0]);
-    string path;
-    if (!builtin) {
-      path = findInPath(cmd.args[0]);
-      if (path.empty()) {
-        cerr << cmd.args[0] << ": command not found" << endl;
-        closePipes(pipes);
-        return;
-      }
+    if (pids[i] <= 0) continue;
+    statuses[i] = waitForChild(pids[i], &usage[i].usage);
+    usage[i].real = monotonicSeconds() - start;
+  }
+  if (group.pgid > 0) reclaimTerminal();
+  pipe_status() = statuses;
+  if (shell_options().pipefail) {
+    for (auto it = statuses.rbegin(); it != statuses.rend(); ++it) {
+      if (*it != 0) return *it;
     }
+  }
+  return statuses.back();
+}
 
-    pid_t pid = fork();
-    if (pid == 0) {
-      runPipelineChild(i, num_commands, pipes, cmd, path, builtin);
-    } else if (pid > 0) {
-      pids.push_back(pid);
-    } else {
-      cerr << "Fork failed" << endl;
-    }
+// Background built-in stage: runs in a forked child wired to its pipes.
+static pid_t forkBuiltinStage(int i, int num_commands, vector<vector<int>>& pipes,
+                              const CommandInfo& cmd, BuiltinHandler run, pid_t pgid) {
+  TraceSpan span("fork", cmd.args.empty() ? string_view() : cmd.args[0]);
+  cout.flush();
+  pid_t pid = fork();
+  if (pid < 0) cerr << "Fork failed" << endl;
+  // Both sides set the group so neither order of execution can miss it.
+  if (pid > 0 && pgid >= 0) setpgid(pid, pgid == 0 ? pid : pgid);
+  if (pid != 0) return pid;
+
+  if (pgid >= 0) setpgid(0, pgid);
+  for (int sig = 1; sig < NSIG; ++sig) {
+    if (sigismember(&childSignalDefaults(), sig) == 1) signal(sig, SIG_DFL);
   }
 
+  if (i > 0) dup2(pipes[i - 1][0], STDIN_FILENO);
+  if (i < num_commands - 1) dup2(pipes[i][1], STDOUT_FILENO);
   closePipes(pipes);
-  for (pid_t pid : pids) {
-    int status;
-    waitpid(pid, &status, 0);
+  CommandInfo redirects = cmd;
+  if (i < num_commands - 1) redirects.has_redirect = false;
+  int saved_stdout = -1;
+  int redirect_fd = -1;
+  int saved_stderr = -1;
+  int error_redirect_fd = -1;
+  setupBuiltinRedirects(redirects, saved_stdout, redirect_fd, saved_stderr, error_redirect_fd);
+  int status = run(cmd.args);
+  cout.flush();
+  cerr.flush();
+  _exit(status);
+}
+
+int launchPipeline(const vector<CommandInfo>& commands, vector<pid_t>& pids) {
+  pids.clear();
+  if (commands.empty()) return 0;
+
+  auto num_commands = (int)commands.size();
+  vector<string> paths;
+  vector<BuiltinHandler> builtins;
+  if (resolveStages(commands, paths, builtins) != -1) return 127;
+
+  vector<vector<int>> pipes(num_commands - 1, vector<int>(2, -1));
+  if (!openPipes(pipes)) return 1;
+
+  // Under job control the first stage leads a new process group that the
+  // others join; background jobs never get the terminal.
+  pid_t pgid = shell_options().monitor ? 0 : -1;
+  int status = 0;
+  for (int i = 0; i < num_commands; ++i) {
+    pid_t pid = builtins[i] ? forkBuiltinStage(i, num_commands, pipes, commands[i], builtins[i], pgid)
+                            : spawnPipelineStage(i, num_commands, pipes, commands[i], paths[i], pgid, -1);
+    if (pid > 0) pids.push_back(pid);
+    else         status = 1;
+    if (pid > 0 && pgid == 0) pgid = pid;
   }
+  closePipes(pipes);
+  return pids.empty() ? status : 0;
 }
 
 void setupBuiltinRedirects(const CommandInfo& cmd,
                            int& saved_stdout, int& redirect_fd,
                            int& saved_stderr, int& error_redirect_fd) {
+  TraceSpan span("redirect");
+  cout.flush();
   if (cmd.has_redirect && !cmd.output_file.empty()) {
     saved_stdout = dup(STDOUT_FILENO);
     int flags = O_WRONLY | O_CREAT | (cmd.is_append ? O_APPEND : O_TRUNC);
@@ -299,6 +410,7 @@ void setupBuiltinRedirects(const CommandInfo& cmd,
 
 void restoreBuiltinRedirects(int& saved_stdout, int& redirect_fd,
                              int& saved_stderr, int& error_redirect_fd) {
+  cout.flush();
   if (saved_stdout != -1) {
     dup2(saved_stdout, STDOUT_FILENO);
     close(saved_stdout);
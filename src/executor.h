@@ -4,23 +4,18 @@
  */
 #pragma once
 
+#include "builtins.h"
 #include "globals.h"
 #include "parser.h"
 
 #include <string>
 #include <string_view>
 #include <vector>
-
-/**
- * @brief Returns true if @p cmd is a recognized shell built-in.
- *
- * @param[in] cmd  The command name to check.
- * @return         true if @p cmd names a built-in, false otherwise.
- */
-bool isBuiltin(std::string_view cmd);
+#include <sys/resource.h>
 
 /**
  * @brief Searches each directory in PATH for an executable named @p program.
+ *        Resolutions are remembered in the command hash (see pathcache.h).
  *
  * @param[in] program  Bare executable name to locate.
  * @return             Absolute path to the first matching executable, or an
@@ -29,16 +24,39 @@ bool isBuiltin(std::string_view cmd);
 std::string findInPath(std::string_view program);
 
 /**
- * @brief Executes a built-in command inside a forked child process, then
- *        calls exit().  Used so built-ins can participate in pipelines.
+ * @brief Foreground stages that stopped (Ctrl-Z) during the last
+ *        executeProgram() / executePipeline(); the caller turns them into
+ *        a stopped job (see suspendForeground()).
+ */
+std::vector<pid_t>& stopped_stages();
+
+/**
+ * @brief Blocks until child @p pid terminates or stops and decodes its
+ *        status.  Stopped children are appended to stopped_stages().
+ *        Other children reaped meanwhile are left to their owners (see
+ *        reaper.h).
  *
+ * @param[in]  pid    Child process to wait for.
+ * @param[out] usage  If non-null, receives the child's rusage from wait4().
+ * @return            The exit code, or 128 + signal number if the child was
+ *                    killed or stopped by a signal.
+ */
+int waitForChild(pid_t pid, rusage* usage = nullptr);
+
+/**
+ * @brief Runs built-in @p run in the shell process and records its wall time
+ *        and the shell's getrusage() delta as the only entry of stage_usage().
+ *
+ * @param[in] run   Handler returned by findBuiltin().
  * @param[in] args  Tokenized command words; args[0] is the built-in name.
+ * @return          The built-in's exit status.
  */
-[[noreturn]] void executeBuiltinInChild(const std::vector<std::string>& args);
+int executeBuiltin(BuiltinHandler run, const std::vector<std::string>& args);
 
 /**
- * @brief Forks a child, optionally redirects stdout/stderr, and runs an
- *        external program via execv().  Waits for the child to exit.
+ * @brief Spawns an external program (see launch.h), optionally redirecting
+ *        stdout/stderr, and waits for it to exit or stop.  Under job
+ *        control it runs in its own process group with the terminal.
  *
  * @param[in] path             Absolute path to the executable.
  * @param[in] args             Argument list; args[0] is the program name.
@@ -46,21 +64,43 @@ std::string findInPath(std::string_view program);
  * @param[in] is_append        If true, open @p output_file in append mode.
  * @param[in] error_file       Redirect stderr to this path; empty = no redirect.
  * @param[in] is_error_append  If true, open @p error_file in append mode.
+ * @param[in] limits           Resource limits to set in the child.
+ * @return                     The program's exit status (see waitForChild),
+ *                             or 127 if it could not be started.  The
+ *                             child's rusage is left in stage_usage().
  */
-void executeProgram(const std::string& path,
-                    const std::vector<std::string>& args,
-                    const std::string& output_file = "",
-                    bool is_append = false,
-                    const std::string& error_file = "",
-                    bool is_error_append = false);
+int executeProgram(const std::string& path,
+                   const std::vector<std::string>& args,
+                   const std::string& output_file = "",
+                   bool is_append = false,
+                   const std::string& error_file = "",
+                   bool is_error_append = false,
+                   const std::vector<ResourceLimit>& limits = {});
 
 /**
- * @brief Executes a sequence of commands connected by pipes.
+ * @brief Executes a sequence of commands connected by pipes.  External
+ *        stages are spawned; built-in stages run inside the shell process,
+ *        writing into their pipe through a buffered writer.
  *
  * @param[in] commands  Ordered list of commands to connect via pipes.
  *                      The last command's stdout/stderr redirects are honoured.
+ * @return              Exit status of the last stage, or of the rightmost
+ *                      failing stage under `set -o pipefail`.  Every
+ *                      stage's status is recorded in pipe_status() and
+ *                      its resource usage in stage_usage().
+ */
+int executePipeline(const std::vector<CommandInfo>& commands);
+
+/**
+ * @brief Starts @p commands as a background pipeline without waiting for
+ *        it.  Built-in stages are forked so they run alongside the shell.
+ *
+ * @param[in]  commands  Ordered list of commands to connect via pipes.
+ * @param[out] pids      Receives the stage process IDs in pipeline order.
+ * @return               0 on success, 127 if a command was not found, or 1
+ *                       if the pipeline could not be set up.
  */
-void executePipeline(const std::vector<CommandInfo>& commands);
+int launchPipeline(const std::vector<CommandInfo>& commands, std::vector<pid_t>& pids);
 
 /**
  * @brief Saves current stdout/stderr and redirects them per @p cmd's
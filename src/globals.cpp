@@ -3,10 +3,11 @@
  * @brief Definitions of global variables shared across modules.
  */
 #include "globals.h"
+#include "trace.h"
 
 #include <algorithm>
-#include <array>
 #include <cctype>
+#include <charconv>
 #include <string_view>
 
 int& last_appended_index() {
@@ -14,8 +15,28 @@ int& last_appended_index() {
   return val;
 }
 
-std::map<std::string, std::string, std::less<>>& completion_registry() {
-  static std::map<std::string, std::string, std::less<>> val;
+bool& exit_requested() {
+  static bool val = false;
+  return val;
+}
+
+int& last_status() {
+  static int val = 0;
+  return val;
+}
+
+std::vector<int>& pipe_status() {
+  static std::vector<int> val{0};
+  return val;
+}
+
+ShellOptions& shell_options() {
+  static ShellOptions val;
+  return val;
+}
+
+std::map<std::string, CompletionSpec, std::less<>>& completion_registry() {
+  static std::map<std::string, CompletionSpec, std::less<>> val;
   return val;
 }
 
@@ -29,15 +50,51 @@ std::map<std::string, std::string, std::less<>>& shell_variables() {
   return val;
 }
 
-static size_t expandBraceVar(const std::string& arg, size_t i, std::string& out) {
+static void expandPipeStatus(std::string_view index, std::string& out) {
+  const std::vector<int>& statuses = pipe_status();
+  if (index == "*") {
+    for (size_t n = 0; n < statuses.size(); ++n) {
+      if (n > 0) out += ' ';
+      out += std::to_string(statuses[n]);
+    }
+    return;
+  }
+  size_t n = 0;
+  auto [ptr, ec] = std::from_chars(index.data(), index.data() + index.size(), n);
+  if (ec == std::errc() && ptr == index.data() + index.size() && n < statuses.size())
+    out += std::to_string(statuses[n]);
+}
+
+static void expandNamedVar(std::string_view varname, std::string& out) {
+  if (varname == "?") {
+    out += std::to_string(last_status());
+  } else if (varname == "PIPESTATUS") {
+    expandPipeStatus("0", out);
+  } else if (varname.starts_with("PIPESTATUS[") && varname.ends_with(']')) {
+    expandPipeStatus(varname.substr(11, varname.size() - 12), out);
+  } else if (auto it = shell_variables().find(varname); it != shell_variables().end()) {
+    out += it->second;
+  }
+}
+
+// ${PIPESTATUS[@]} yields one word per status, as in bash: the first
+// joins the text before it and the last the text after it.
+static size_t expandBraceVar(const std::string& arg, size_t i, std::vector<std::string>& words) {
   size_t start = i + 2;
   if (size_t close = arg.find('}', start); close != std::string::npos) {
-    std::string varname = arg.substr(start, close - start);
-    if (auto it = shell_variables().find(varname); it != shell_variables().end())
-      out += it->second;
+    std::string_view varname = std::string_view(arg).substr(start, close - start);
+    if (varname == "PIPESTATUS[@]") {
+      const std::vector<int>& statuses = pipe_status();
+      for (size_t n = 0; n < statuses.size(); ++n) {
+        if (n > 0) words.emplace_back();
+        words.back() += std::to_string(statuses[n]);
+      }
+    } else {
+      expandNamedVar(varname, words.back());
+    }
     return close + 1;
   }
-  out += arg[i];
+  words.back() += arg[i];
   return i + 1;
 }
 
@@ -46,29 +103,34 @@ static size_t expandBareVar(const std::string& arg, size_t i, std::string& out)
   size_t end   = start;
   while (end < arg.size() && (std::isalnum((unsigned char)arg[end]) || arg[end] == '_'))
     ++end;
-  std::string varname = arg.substr(start, end - start);
-  if (auto it = shell_variables().find(varname); it != shell_variables().end())
-    out += it->second;
+  expandNamedVar(std::string_view(arg).substr(start, end - start), out);
   return end;
 }
 
 void expandArgs(std::vector<std::string>& args) {
-  for (auto& arg : args) {
-    std::string expanded;
+  TraceSpan span("expandArgs", args.empty() ? std::string_view() : args[0]);
+  std::vector<std::string> expanded_args;
+  expanded_args.reserve(args.size());
+  for (const auto& arg : args) {
+    std::vector<std::string> words(1);
     size_t i = 0;
     while (i < arg.size()) {
       if (arg[i] == '$' && i + 1 < arg.size() && arg[i+1] == '{') {
-        i = expandBraceVar(arg, i, expanded);
+        i = expandBraceVar(arg, i, words);
+      } else if (arg[i] == '$' && i + 1 < arg.size() && arg[i+1] == '?') {
+        expandNamedVar("?", words.back());
+        i += 2;
       } else if (arg[i] == '$' && i + 1 < arg.size() &&
                  (std::isalpha((unsigned char)arg[i+1]) || arg[i+1] == '_')) {
-        i = expandBareVar(arg, i, expanded);
+        i = expandBareVar(arg, i, words.back());
       } else {
-        expanded += arg[i];
+        words.back() += arg[i];
         ++i;
       }
     }
-    arg = expanded;
+    for (auto& word : words) expanded_args.push_back(std::move(word));
   }
+  args = std::move(expanded_args);
   if (args.size() > 1) {
     args.erase(
       std::remove_if(args.begin() + 1, args.end(),
@@ -77,16 +139,3 @@ void expandArgs(std::vector<std::string>& args) {
     );
   }
 }
-
-const std::array<const char*, 10> builtin_commands = {
-  "echo",
-  "exit",
-  "type",
-  "pwd",
-  "cd",
-  "history",
-  "jobs",
-  "complete",
-  "declare",
-  nullptr
-};
@@ -4,7 +4,8 @@
  */
 #pragma once
 
-#include <array>
+#include "parser.h"
+
 #include <string>
 #include <vector>
 #include <map>
@@ -17,24 +18,88 @@
 int& last_appended_index();
 
 /**
- * @brief Maps a command name to the path of its external completion script.
- *        Populated by `complete -C <script> <cmd>`.
+ * @brief Set by the `exit` built-in; the REPL stops once it is true.
+ */
+bool& exit_requested();
+
+/**
+ * @brief Exit status of the most recently completed foreground pipeline
+ *        (`$?`).  Signal deaths are recorded as 128 + signal number.
+ */
+int& last_status();
+
+/**
+ * @brief Per-stage exit statuses of the most recent foreground pipeline
+ *        (`PIPESTATUS`); a single command yields a one-element list.
+ */
+std::vector<int>& pipe_status();
+
+/**
+ * @brief Shell options toggled with `set -o name` / `set +o name`.
+ *
+ * @var ShellOptions::pipefail    A pipeline's status is that of its rightmost
+ *                                failing stage instead of its last stage.
+ * @var ShellOptions::trace_perf  Record execution-phase spans (see trace.h).
+ * @var ShellOptions::monitor     Job control: every pipeline runs in its own
+ *                                process group.  On by default when the
+ *                                shell is interactive.
+ */
+struct ShellOptions {
+  bool pipefail = false;
+  bool trace_perf = false;
+  bool monitor = false;
+};
+
+/** @brief The live option set of this shell session. */
+ShellOptions& shell_options();
+
+/**
+ * @brief An external completer registered for a command.
+ *
+ * @var CompletionSpec::completer  Program and optional arguments.
+ * @var CompletionSpec::server     Run once as a co-process answering every
+ *                                 request (`complete -S`) instead of once
+ *                                 per Tab (`complete -C`).
  */
-std::map<std::string, std::string, std::less<>>& completion_registry();
+struct CompletionSpec {
+  std::string completer;
+  bool server = false;
+};
 
 /**
- * @brief Represents a single background job launched with `&`.
+ * @brief Maps a command name to its external completer.  Populated by
+ *        `complete -C <script> <cmd>` and `complete -S <server> <cmd>`.
+ */
+std::map<std::string, CompletionSpec, std::less<>>& completion_registry();
+
+/**
+ * @brief Represents a single job launched with `&` or stopped in the
+ *        foreground.  A pipeline is one job covering all of its stages.
  *
  * @var BackgroundJob::job_number  Shell-assigned job index (≥ 1), unique among active jobs.
- * @var BackgroundJob::pid         OS process ID of the background child.
+ * @var BackgroundJob::pid         OS process ID of the job's last stage (as printed by `&`).
  * @var BackgroundJob::command     Raw command string as typed by the user.
- * @var BackgroundJob::done        Set to true when the child has exited or been signalled.
+ * @var BackgroundJob::done        Set to true once every stage has exited or been signalled.
+ * @var BackgroundJob::pids        Stage process IDs in pipeline order.
+ * @var BackgroundJob::queued      True while the job waits for a free job slot.
+ * @var BackgroundJob::pending     Expanded stages of a queued job, consumed on launch.
+ * @var BackgroundJob::status      Exit status of the last stage, valid once done.
+ * @var BackgroundJob::live        Number of stages not yet reaped.
+ * @var BackgroundJob::pgid        Process group of the job under job control, else 0.
+ * @var BackgroundJob::stopped     True while the job is stopped (Ctrl-Z, SIGSTOP, SIGTTIN).
  */
 struct BackgroundJob {
   int job_number;
   pid_t pid;
   std::string command;
   bool done = false;
+  std::vector<pid_t> pids;
+  bool queued = false;
+  std::vector<CommandInfo> pending;
+  int status = 0;
+  int live = 0;
+  pid_t pgid = 0;
+  bool stopped = false;
 };
 
 /** @brief The live list of background jobs managed by this shell session. */
@@ -43,13 +108,13 @@ std::vector<BackgroundJob>& bg_jobs();
 /** @brief Shell variable store populated by the declare builtin. */
 std::map<std::string, std::string, std::less<>>& shell_variables();
 
-/** @brief Null-terminated array of built-in command names. */
-extern const std::array<const char*, 10> builtin_commands;
-
 /**
  * @brief Expands $VAR and ${VAR} references in-place for every element of
- *        @p args.  Non-program arguments that expand to an empty string
- *        (i.e. an unset variable with no surrounding text) are dropped.
+ *        @p args.  Also expands `$?`, `${PIPESTATUS[n]}`,
+ *        `${PIPESTATUS[*]}` and `${PIPESTATUS[@]}` from the recorded exit
+ *        statuses; the `@` form yields one argument per status.
+ *        Non-program arguments that expand to an empty string (i.e. an
+ *        unset variable with no surrounding text) are dropped.
  *        args[0] (the program name) is never removed.
  *
  * @param[in,out] args  Token list to expand; modified in place.
@@ -0,0 +1,292 @@
+/**
+ * @file histfile.cpp
+ * @brief Implementation of locked, append-only history file persistence.
+ */
+#include "histfile.h"
+#include "histlist.h"
+#include "histsearch.h"
+#include "globals.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <readline/history.h>
+
+using namespace std;
+
+namespace {
+
+// Entries handed to readline before the first prompt; the rest wait.
+constexpr size_t kEagerEntries = 1000;
+
+// Appends between two trims of the history file.
+constexpr int kTrimInterval = 64;
+
+/** An open history file holding an flock() until it goes out of scope. */
+class LockedFile {
+ public:
+  LockedFile(const string& path, int flags, int lock) {
+    fd_ = open(path.c_str(), flags | O_CLOEXEC, 0600);
+    if (fd_ == -1) return;
+    while (flock(fd_, lock) == -1) {
+      if (errno != EINTR) { close(fd_); fd_ = -1; return; }
+    }
+  }
+  ~LockedFile() { if (fd_ != -1) close(fd_); }
+  LockedFile(const LockedFile&) = delete;
+  LockedFile& operator=(const LockedFile&) = delete;
+
+  int fd() const { return fd_; }
+  explicit operator bool() const { return fd_ != -1; }
+
+ private:
+  int fd_ = -1;
+};
+
+/**
+ * Older HISTFILE entries loaded at startup but not yet given to readline.
+ * The descriptor stays open so the mapping can be re-checked under a
+ * shared lock before it is read.
+ */
+struct DeferredHistory {
+  int fd = -1;
+  const char* data = nullptr;
+  size_t size = 0;
+  size_t end = 0;  // where the entries already given to readline begin
+  timespec mtime{};
+  size_t tail_hash = 0;  // of the bytes [end, size) read at startup
+};
+
+} // namespace
+
+static DeferredHistory& deferredHistory() {
+  static DeferredHistory val;
+  return val;
+}
+
+static void releaseDeferred(DeferredHistory& deferred) {
+  if (deferred.data) munmap(const_cast<char*>(deferred.data), deferred.size);
+  if (deferred.fd != -1) close(deferred.fd);
+  deferred = DeferredHistory{};
+}
+
+// Splits data into entries, attaching each `#` timestamp line to the
+// command that follows it.  Empty lines are skipped.
+static vector<HistoryLine> entriesIn(string_view data) {
+  vector<HistoryLine> entries;
+  string_view stamp;
+  for (size_t pos = 0; pos < data.size();) {
+    size_t nl = data.find('\n', pos);
+    if (nl == string_view::npos) nl = data.size();
+    string_view line = data.substr(pos, nl - pos);
+    if (isHistoryStamp(line)) {
+      stamp = line;
+    } else if (!line.empty()) {
+      entries.push_back({line, stamp});
+      stamp = {};
+    }
+    pos = nl + 1;
+  }
+  return entries;
+}
+
+// Walks back from the end of @p data over its newest @p count entries,
+// touching nothing before them.  Timestamp lines are not counted but stay
+// with their command.  Returns the offset the entries start at and the
+// number found in @p found.
+static size_t tailStart(string_view data, size_t count, size_t& found) {
+  size_t end = data.size();
+  found = 0;
+  while (end > 0) {
+    const void* nl = end > 1 ? memrchr(data.data(), '\n', end - 1) : nullptr;
+    size_t start = nl ? static_cast<const char*>(nl) - data.data() + 1 : 0;
+    string_view line = data.substr(start, end - start);
+    if (line.ends_with('\n')) line.remove_suffix(1);
+    if (!line.empty() && !isHistoryStamp(line)) {
+      if (found == count) break;
+      ++found;
+    }
+    end = start;
+  }
+  return end;
+}
+
+static bool writeAll(int fd, string_view data) {
+  while (!data.empty()) {
+    ssize_t n = write(fd, data.data(), data.size());
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+// Reads up to out.size() bytes at @p offset; @p out is cut to what was read.
+static void readAt(int fd, size_t offset, string& out) {
+  size_t got = 0;
+  while (got < out.size()) {
+    ssize_t n = pread(fd, out.data() + got, out.size() - got, offset + got);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) break;
+    got += n;
+  }
+  out.resize(got);
+}
+
+static bool readAll(int fd, string& out) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) return false;
+  out.resize(st.st_size);
+  readAt(fd, 0, out);
+  return true;
+}
+
+static void appendEntry(string& buf, const HIST_ENTRY* entry) {
+  if (!entry) return;
+  if (entry->timestamp && isHistoryStamp(entry->timestamp)) {
+    buf += entry->timestamp;
+    buf += '\n';
+  }
+  buf += entry->line;
+  buf += '\n';
+}
+
+// The one formatter behind `history -a`, `history -w` and per-command
+// appends: entries are joined into a single buffer for a single write().
+static string formatEntries(int first, int end) {
+  string buf;
+  for (int i = first; i < end; ++i) appendEntry(buf, history_get(i));
+  return buf;
+}
+
+bool readHistoryFile(const string& path) {
+  LockedFile file(path, O_RDONLY, LOCK_SH);
+  string data;
+  if (!file || !readAll(file.fd(), data)) return false;
+  for (const auto& entry : entriesIn(data)) {
+    pushHistory(entry.line, entry.stamp);
+    indexHistory(entry.line);
+  }
+  return true;
+}
+
+bool loadHistoryFile(const string& path) {
+  if (history_length > 0) return readHistoryFile(path);
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return false;
+  struct stat st;
+  if (flock(fd, LOCK_SH) != 0 || fstat(fd, &st) != 0) { close(fd); return false; }
+  if (st.st_size == 0) { close(fd); return true; }
+  auto size = static_cast<size_t>(st.st_size);
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) { close(fd); return false; }
+  const char* data = static_cast<const char*>(map);
+
+  // Only the tail is touched before the first prompt: walk back over the
+  // newest lines, leaving the rest of the mapping unread.
+  size_t limit = historyLimit();
+  size_t eager = 0;
+  size_t end = tailStart({data, size}, min(limit, kEagerEntries), eager);
+  for (const auto& entry : entriesIn({data + end, size - end})) pushHistory(entry.line, entry.stamp);
+  flock(fd, LOCK_UN);
+
+  // Under a HISTSIZE the eager entries already fill, older ones would only
+  // be evicted again.
+  DeferredHistory& deferred = deferredHistory();
+  deferred = {fd, data, size, eager < limit ? end : 0, st.st_mtim,
+              hash<string_view>{}({data + end, size - end})};
+  if (deferred.end == 0) releaseDeferred(deferred);
+  return true;
+}
+
+bool historyDeferred() {
+  return deferredHistory().end > 0;
+}
+
+// Whether the mapped bytes are still the file as it was at startup.
+// Another shell may have rewritten it in place since: trimming drops the
+// oldest lines, which are exactly the deferred ones, and moves the rest to
+// the front, and the file may have grown past its old size again by now.
+// Appends change the mtime too but move nothing, so after any change the
+// entries read at startup must still be found where they were.
+static bool mappingCurrent(const DeferredHistory& deferred, const struct stat& st) {
+  if (static_cast<size_t>(st.st_size) < deferred.size) return false;
+  if (st.st_mtim.tv_sec == deferred.mtime.tv_sec && st.st_mtim.tv_nsec == deferred.mtime.tv_nsec)
+    return true;
+  string tail(deferred.size - deferred.end, '\0');
+  readAt(deferred.fd, deferred.end, tail);
+  return tail.size() == deferred.size - deferred.end && hash<string_view>{}(tail) == deferred.tail_hash;
+}
+
+void materializeHistory() {
+  DeferredHistory& deferred = deferredHistory();
+  if (deferred.end == 0) return;
+  struct stat st;
+  if (flock(deferred.fd, LOCK_SH) != 0 || fstat(deferred.fd, &st) != 0 || !mappingCurrent(deferred, st)) {
+    releaseDeferred(deferred);
+    return;
+  }
+
+  auto older = static_cast<int>(prependHistory(entriesIn({deferred.data, deferred.end})));
+  if (last_appended_index() != -1) last_appended_index() += older;
+  releaseDeferred(deferred);
+}
+
+bool appendHistoryFile(const string& path, int first, int end) {
+  LockedFile file(path, O_WRONLY | O_APPEND | O_CREAT, LOCK_EX);
+  return file && writeAll(file.fd(), formatEntries(first, end));
+}
+
+bool writeHistoryFile(const string& path) {
+  // The deferred entries belong in the file, and the mapping would not
+  // survive the rewrite.
+  materializeHistory();
+  // Truncate only once the lock is held, so a concurrent reader never sees
+  // a half-written file.
+  LockedFile file(path, O_WRONLY | O_CREAT, LOCK_EX);
+  return file && ftruncate(file.fd(), 0) == 0 &&
+         writeAll(file.fd(), formatEntries(history_base, history_base + history_length));
+}
+
+void recordHistory(const string& path, const HIST_ENTRY* entry) {
+  static int appends = 0;
+  if (path.empty() || !entry) return;
+  {
+    LockedFile file(path, O_WRONLY | O_APPEND | O_CREAT, LOCK_EX);
+    if (!file) return;
+    string buf;
+    appendEntry(buf, entry);
+    writeAll(file.fd(), buf);
+  }
+  if (++appends % kTrimInterval == 0) trimHistoryFile(path, historyFileLimit());
+}
+
+void trimHistoryFile(const string& path, size_t max_lines) {
+  if (path.empty() || max_lines == numeric_limits<size_t>::max()) return;
+  // Before the rewrite moves the bytes under the mapping, and before the
+  // exclusive lock, which the shared one taken here would wait on.
+  materializeHistory();
+  LockedFile file(path, O_RDWR, LOCK_EX);
+  string data;
+  if (!file || !readAll(file.fd(), data)) return;
+
+  size_t found = 0;
+  size_t keep_from = tailStart(data, max_lines, found);
+  if (keep_from == 0) return;
+
+  string_view tail = string_view(data).substr(keep_from);
+  if (lseek(file.fd(), 0, SEEK_SET) == 0 && writeAll(file.fd(), tail))
+    ftruncate(file.fd(), tail.size());
+}
+
+size_t historyFileLimit() {
+  return historySetting("HISTFILESIZE");
+}
@@ -0,0 +1,98 @@
+/**
+ * @file histfile.h
+ * @brief History file persistence.  Every access takes an flock() on the
+ *        file, and interactive commands are appended one write() at a
+ *        time as they are entered, so concurrent shells interleave their
+ *        history instead of overwriting each other's.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <readline/history.h>
+
+/**
+ * @brief Adds every non-empty line of @p path to the in-memory history,
+ *        under a shared lock.
+ *
+ * @param[in] path  History file to read.
+ * @return          false if @p path cannot be opened.
+ */
+bool readHistoryFile(const std::string& path);
+
+/**
+ * @brief Startup load of @p path.  The file is mapped and only its newest
+ *        entries are found (scanning back from the end) and added to
+ *        readline's history right away.  Older entries stay unread in the
+ *        mapping until materializeHistory().
+ *
+ * @param[in] path  History file to load.  If the in-memory history is not
+ *                  empty, the whole file is read as by readHistoryFile().
+ * @return          false if @p path cannot be opened or mapped.
+ */
+bool loadHistoryFile(const std::string& path);
+
+/**
+ * @brief True while loadHistoryFile() has entries that readline has not
+ *        seen yet.
+ */
+bool historyDeferred();
+
+/**
+ * @brief Indexes the entries deferred by loadHistoryFile() by line offset,
+ *        puts them in front of the in-memory history in one step and
+ *        releases the mapping.  Does nothing if none are deferred.
+ *
+ * If the file was rewritten in place since it was mapped, the deferred
+ * entries are dropped instead; writeHistoryFile() and trimHistoryFile()
+ * call this first so the shell's own rewrites never cost them.
+ */
+void materializeHistory();
+
+/**
+ * @brief Appends in-memory history entries [@p first, @p end) to @p path
+ *        with a single write() under an exclusive lock (`history -a`).
+ *
+ * @param[in] path   History file; created if missing.
+ * @param[in] first  Readline index of the first entry to write.
+ * @param[in] end    One past the readline index of the last entry.
+ * @return           false if @p path cannot be opened or written.
+ */
+bool appendHistoryFile(const std::string& path, int first, int end);
+
+/**
+ * @brief Replaces the contents of @p path with the whole in-memory history
+ *        (`history -w`).
+ *
+ * @param[in] path  History file; created if missing.
+ * @return          false if @p path cannot be opened or written.
+ */
+bool writeHistoryFile(const std::string& path);
+
+/**
+ * @brief Appends one finished command, with its `#start seconds status`
+ *        line, to @p path.  Every few dozen appends the file is also
+ *        trimmed to historyFileLimit() entries.
+ *
+ * @param[in] path   History file; nothing happens if empty.
+ * @param[in] entry  The entry returned by finishHistory(); may be null.
+ */
+void recordHistory(const std::string& path, const HIST_ENTRY* entry);
+
+/**
+ * @brief Drops the oldest entries of @p path until at most @p max_lines
+ *        remain; timestamp lines are not counted.  The file is rewritten
+ *        in place under an exclusive lock, and only when it is actually
+ *        over the limit.
+ *
+ * @param[in] path       History file; nothing happens if it does not exist.
+ * @param[in] max_lines  Number of most recent entries to keep.
+ */
+void trimHistoryFile(const std::string& path, size_t max_lines);
+
+/**
+ * @brief Maximum number of entries kept in the history file (HISTFILESIZE),
+ *        read as by historySetting().
+ */
+size_t historyFileLimit();
@@ -0,0 +1,299 @@
+/**
+ * @file histlist.cpp
+ * @brief Implementation of the bounded, deduplicating history list.
+ */
+#include "histlist.h"
+#include "globals.h"
+#include "histsearch.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <readline/history.h>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t kDefaultSize = 500;
+constexpr size_t kNoLimit = numeric_limits<size_t>::max();
+
+struct LineHash {
+  using is_transparent = void;
+  size_t operator()(string_view s) const { return hash<string_view>{}(s); }
+};
+
+using LineTable = unordered_multimap<string, int64_t, LineHash, equal_to<>>;
+
+/** What the list recorded about an entry when it stored it. */
+struct Stored {
+  int64_t seq;
+  const string* line;  // key of the entry's node in HistoryList::lines
+};
+
+/**
+ * Entries occupy slots[start, start + length); slots[start + length] is
+ * the nullptr readline expects after the last entry.
+ *
+ * Readline's replace_history_entry() frees the entry in a slot and puts a
+ * new one there when a recalled line is edited, so nothing but the slot
+ * itself refers to a HIST_ENTRY: stored[i] describes slots[i] by its own
+ * copy of the line and a sequence number.
+ */
+struct HistoryList {
+  HIST_ENTRY** slots = nullptr;
+  vector<Stored> stored;
+  size_t capacity = 0;
+  size_t start = 0;
+  size_t length = 0;
+  // Every stored line with its entry's sequence number.  Sequence numbers
+  // increase along the window, so an entry's slot is found by binary
+  // search.  Appends count up from 0 and prepends down from -1.
+  LineTable lines;
+  int64_t next_seq = 0;
+  int64_t first_seq = 0;
+  // Entry from the last addHistory(), until finishHistory().
+  optional<int64_t> pending;
+};
+
+constexpr size_t kNoSlot = numeric_limits<size_t>::max();
+
+} // namespace
+
+static HistoryList& historyList() {
+  static HistoryList val;
+  return val;
+}
+
+size_t historySetting(const char* name) {
+  string_view value;
+  if (auto it = shell_variables().find(name); it != shell_variables().end()) {
+    value = it->second;
+  } else if (const char* env = getenv(name)) {
+    value = env;
+  } else {
+    return kDefaultSize;
+  }
+  long long limit = -1;
+  auto [end, ec] = from_chars(value.data(), value.data() + value.size(), limit);
+  if (ec != errc() || end != value.data() + value.size() || limit < 0) return kNoLimit;
+  return static_cast<size_t>(limit);
+}
+
+size_t historyLimit() {
+  return historySetting("HISTSIZE");
+}
+
+static void publish(HistoryList& list, size_t offset) {
+  list.slots[list.start + list.length] = nullptr;
+  HISTORY_STATE state{};
+  state.entries = list.slots + list.start;
+  state.offset = static_cast<int>(offset);
+  state.length = static_cast<int>(list.length);
+  state.size = static_cast<int>(list.capacity - list.start);
+  history_set_history_state(&state);
+}
+
+static char* copyStamp(string_view stamp) {
+  auto* copy = static_cast<char*>(malloc(stamp.size() + 1));
+  stamp.copy(copy, stamp.size());
+  copy[stamp.size()] = '\0';
+  return copy;
+}
+
+static HIST_ENTRY* newEntry(string_view line, string_view stamp) {
+  string text(line);
+  return alloc_history_entry(text.data(), copyStamp(stamp));
+}
+
+bool isHistoryStamp(string_view line) {
+  return line.size() > 1 && line[0] == '#' && line[1] >= '0' && line[1] <= '9';
+}
+
+HistoryStamp parseHistoryStamp(const char* stamp) {
+  HistoryStamp out;
+  if (!stamp || !isHistoryStamp(stamp)) return out;
+  string_view rest(stamp + 1);
+  long long start = 0;
+  auto next = [&](auto& value) {
+    while (rest.starts_with(' ')) rest.remove_prefix(1);
+    auto [end, ec] = from_chars(rest.data(), rest.data() + rest.size(), value);
+    if (ec != errc()) return false;
+    rest.remove_prefix(end - rest.data());
+    return true;
+  };
+  if (next(start)) out.start = static_cast<time_t>(start);
+  if (next(out.seconds)) next(out.status);
+  return out;
+}
+
+static Stored remember(HistoryList& list, string_view line, int64_t seq) {
+  return {seq, &list.lines.emplace(string(line), seq)->first};
+}
+
+// The slot holding the entry numbered @p seq, or kNoSlot.
+static size_t slotOf(const HistoryList& list, int64_t seq) {
+  auto begin = list.stored.data() + list.start;
+  auto end = begin + list.length;
+  auto it = ranges::lower_bound(begin, end, seq, {}, &Stored::seq);
+  return it != end && it->seq == seq ? static_cast<size_t>(it - list.stored.data()) : kNoSlot;
+}
+
+// Frees the entry in @p slot and drops what was recorded about it; the
+// caller closes the gap.
+static void forget(HistoryList& list, size_t slot) {
+  auto [seq, line] = list.stored[slot];
+  if (list.pending == seq) list.pending.reset();
+  unindexHistory(*line);
+  auto [first, last] = list.lines.equal_range(*line);
+  for (auto it = first; it != last; ++it) {
+    if (it->second == seq) { list.lines.erase(it); break; }
+  }
+  free(free_history_entry(list.slots[slot]));
+}
+
+static void evictOldest(HistoryList& list) {
+  forget(list, list.start);
+  ++list.start;
+  --list.length;
+  ++history_base;
+}
+
+// Makes room for @p extra more entries plus the terminator: slide the
+// window back to the front if that is enough, otherwise grow the array.
+static void reserve(HistoryList& list, size_t extra, size_t limit) {
+  size_t needed = list.length + extra + 1;
+  if (list.start + needed <= list.capacity) return;
+  if (list.start > 0) {
+    copy_n(list.slots + list.start, list.length, list.slots);
+    copy_n(list.stored.data() + list.start, list.length, list.stored.data());
+    list.start = 0;
+  }
+  if (needed <= list.capacity) return;
+  size_t ceiling = limit == kNoLimit ? kNoLimit : 2 * limit + 1;
+  size_t target = max(needed, min(ceiling, max<size_t>(64, list.capacity * 2)));
+  list.slots = static_cast<HIST_ENTRY**>(realloc(list.slots, target * sizeof(HIST_ENTRY*)));
+  list.stored.resize(target);
+  list.capacity = target;
+}
+
+static optional<int64_t> append(HistoryList& list, string_view line, string_view stamp, size_t limit) {
+  if (limit == 0) return nullopt;
+  while (list.length >= limit) evictOldest(list);
+  reserve(list, 1, limit);
+  size_t slot = list.start + list.length++;
+  list.slots[slot] = newEntry(line, stamp);
+  list.stored[slot] = remember(list, line, list.next_seq++);
+  publish(list, list.length);
+  return list.stored[slot].seq;
+}
+
+// erasedups: drops every stored copy of @p line.  The hash finds the
+// copies and a binary search over sequence numbers finds their slots;
+// the entries between them then move down in one pass.
+static void eraseCopies(HistoryList& list, string_view line) {
+  auto [first, last] = list.lines.equal_range(line);
+  vector<size_t> copies;
+  for (auto it = first; it != last; ++it) {
+    if (size_t slot = slotOf(list, it->second); slot != kNoSlot) copies.push_back(slot);
+  }
+  if (copies.empty()) return;
+  ranges::sort(copies);
+  for (size_t slot : copies) forget(list, slot);
+
+  size_t end = list.start + list.length;
+  size_t out = copies[0];
+  for (size_t i = 0; i < copies.size(); ++i) {
+    size_t from = copies[i] + 1;
+    size_t to = i + 1 < copies.size() ? copies[i + 1] : end;
+    copy(list.slots + from, list.slots + to, list.slots + out);
+    copy(list.stored.data() + from, list.stored.data() + to, list.stored.data() + out);
+    out += to - from;
+  }
+  list.length -= copies.size();
+  publish(list, list.length);
+}
+
+static bool hasFlag(string_view control, string_view flag) {
+  while (!control.empty()) {
+    size_t colon = control.find(':');
+    if (control.substr(0, colon) == flag) return true;
+    if (colon == string_view::npos) break;
+    control.remove_prefix(colon + 1);
+  }
+  return false;
+}
+
+bool addHistory(string_view line) {
+  HistoryList& list = historyList();
+  string_view control;
+  if (auto it = shell_variables().find("HISTCONTROL"); it != shell_variables().end()) {
+    control = it->second;
+  } else if (const char* env = getenv("HISTCONTROL")) {
+    control = env;
+  }
+  bool both = hasFlag(control, "ignoreboth");
+  if ((both || hasFlag(control, "ignorespace")) && line.starts_with(' ')) return false;
+  if ((both || hasFlag(control, "ignoredups")) && list.length > 0 &&
+      line == *list.stored[list.start + list.length - 1].line) {
+    return false;
+  }
+  if (hasFlag(control, "erasedups")) eraseCopies(list, line);
+  string stamp = "#" + to_string(time(nullptr));
+  list.pending = append(list, line, stamp, historyLimit());
+  return list.pending.has_value();
+}
+
+const HIST_ENTRY* finishHistory(double seconds, int status) {
+  HistoryList& list = historyList();
+  optional<int64_t> seq = exchange(list.pending, nullopt);
+  size_t slot = seq ? slotOf(list, *seq) : kNoSlot;
+  if (slot == kNoSlot) return nullptr;
+  HIST_ENTRY* entry = list.slots[slot];
+  char duration[32];
+  auto [end, ec] = to_chars(duration, duration + sizeof duration, seconds, chars_format::fixed, 3);
+  string stamp = "#" + to_string(parseHistoryStamp(entry->timestamp).start) + ' ' +
+                 string(duration, end) + ' ' + to_string(status);
+  free(entry->timestamp);
+  entry->timestamp = copyStamp(stamp);
+  return entry;
+}
+
+void pushHistory(string_view line, string_view stamp) {
+  append(historyList(), line, stamp, historyLimit());
+}
+
+size_t prependHistory(span<const HistoryLine> lines) {
+  HistoryList& list = historyList();
+  size_t limit = historyLimit();
+  size_t room = limit == kNoLimit ? lines.size() : limit - min(limit, list.length);
+  lines = lines.last(min(room, lines.size()));
+  if (lines.empty()) return 0;
+
+  size_t offset = where_history();
+  reserve(list, lines.size(), limit);
+  if (list.start >= lines.size()) {
+    list.start -= lines.size();
+  } else {
+    copy_backward(list.slots + list.start, list.slots + list.start + list.length,
+                  list.slots + lines.size() + list.length);
+    copy_backward(list.stored.data() + list.start, list.stored.data() + list.start + list.length,
+                  list.stored.data() + lines.size() + list.length);
+    list.start = 0;
+  }
+  list.first_seq -= static_cast<int64_t>(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    list.slots[list.start + i] = newEntry(lines[i].line, lines[i].stamp);
+    list.stored[list.start + i] = remember(list, lines[i].line, list.first_seq + static_cast<int64_t>(i));
+  }
+  list.length += lines.size();
+  publish(list, offset + lines.size());
+  return lines.size();
+}
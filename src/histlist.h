@@ -0,0 +1,119 @@
+/**
+ * @file histlist.h
+ * @brief The in-memory history list handed to readline, bounded by
+ *        HISTSIZE and filtered by HISTCONTROL.
+ *
+ * Entries live in a window sliding over an array of twice HISTSIZE
+ * slots: evicting the oldest entry only advances the window start, and
+ * the window is copied back to the front once it reaches the end of the
+ * array, so each add costs amortised O(1) and memory stays flat.  Every
+ * change is published to readline with history_set_history_state();
+ * nothing else may call add_history().  Entries leaving the list are
+ * also dropped from the search index (see histsearch.h).
+ */
+#pragma once
+
+#include <cstddef>
+#include <ctime>
+#include <span>
+#include <string_view>
+#include <readline/history.h>
+
+/**
+ * @brief One history line read from a file, with the `#` comment line
+ *        that preceded it.
+ *
+ * @var HistoryLine::line   The command.
+ * @var HistoryLine::stamp  Its `#start [seconds status]` line, or empty.
+ */
+struct HistoryLine {
+  std::string_view line;
+  std::string_view stamp;
+};
+
+/**
+ * @brief What an entry's timestamp records.  Entries are stamped
+ *        `#start seconds status`; bash reads only the leading `#start`, so
+ *        the file stays compatible with its HISTTIMEFORMAT format.
+ *
+ * @var HistoryStamp::start    Epoch seconds the command was entered; 0 if
+ *                             unknown.
+ * @var HistoryStamp::seconds  Wall-clock duration; negative if unknown.
+ * @var HistoryStamp::status   Exit status; -1 if unknown.
+ */
+struct HistoryStamp {
+  time_t start = 0;
+  double seconds = -1;
+  int status = -1;
+};
+
+/**
+ * @brief Parses an entry's timestamp string.
+ *
+ * @param[in] stamp  HIST_ENTRY::timestamp; may be null or empty.
+ * @return           The recorded fields; unknown ones keep their defaults.
+ */
+HistoryStamp parseHistoryStamp(const char* stamp);
+
+/**
+ * @brief True if @p line is a history timestamp line (`#` and a digit).
+ */
+bool isHistoryStamp(std::string_view line);
+
+/**
+ * @brief Adds an interactively entered line, honouring the colon-separated
+ *        HISTCONTROL flags `ignorespace`, `ignoredups`, `ignoreboth` and
+ *        `erasedups`.  Earlier copies erased by `erasedups` are found
+ *        through a hash of the stored lines and located in the array by
+ *        binary search rather than a scan.
+ *
+ * The entry is stamped with the current time and becomes the pending
+ * entry that finishHistory() completes.
+ *
+ * @param[in] line  The command as entered.
+ * @return          true if the line was stored, false if HISTCONTROL or a
+ *                  zero HISTSIZE dropped it.
+ */
+bool addHistory(std::string_view line);
+
+/**
+ * @brief Records the duration and exit status of the entry added by the
+ *        last addHistory().
+ *
+ * @param[in] seconds  Wall-clock time the command line took.
+ * @param[in] status   Its exit status.
+ * @return             The completed entry, or nullptr if it was not stored
+ *                     or has since been evicted.
+ */
+const HIST_ENTRY* finishHistory(double seconds, int status);
+
+/**
+ * @brief Appends @p line unconditionally (history file loads), evicting
+ *        the oldest entry once historyLimit() is reached.
+ *
+ * @param[in] line   The history line.
+ * @param[in] stamp  Its timestamp line from the file, or empty.
+ */
+void pushHistory(std::string_view line, std::string_view stamp = {});
+
+/**
+ * @brief Inserts @p lines, oldest first, in front of every stored entry.
+ *        Only the newest of them that fit under historyLimit() are kept.
+ *
+ * @param[in] lines  Older history lines, oldest first.
+ * @return           Number of entries actually inserted.
+ */
+size_t prependHistory(std::span<const HistoryLine> lines);
+
+/**
+ * @brief Reads a history size setting: the shell variable @p name, else
+ *        the environment variable, else 500.  A non-numeric or negative
+ *        value means no limit.
+ *
+ * @param[in] name  HISTSIZE or HISTFILESIZE.
+ * @return          The limit, or SIZE_MAX for none.
+ */
+size_t historySetting(const char* name);
+
+/** @brief Maximum number of entries kept in memory (HISTSIZE). */
+size_t historyLimit();
@@ -0,0 +1,218 @@
+/**
+ * @file histsearch.cpp
+ * @brief Implementation of the trigram history index and its search widget.
+ */
+#include "histsearch.h"
+#include "histfile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <cstdio>
+// Without these readline declares rl_message() with no parameters.
+#define USE_VARARGS
+#define PREFER_STDARG
+#include <readline/readline.h>
+#include <readline/history.h>
+
+using namespace std;
+
+namespace {
+
+// Upper bound on the matches the widget cycles through with C-r.
+constexpr size_t kWidgetMatches = 256;
+
+// Dead lines tolerated beyond the live ones before the index is rebuilt.
+constexpr size_t kDeadSlack = 1024;
+
+/** One distinct history line. */
+struct IndexedLine {
+  string text;
+  uint32_t count;  // entries in the history list; 0 once all have left it
+  uint64_t last;   // sequence number of the latest entry
+};
+
+struct HistoryIndex {
+  bool built = false;
+  uint64_t seq = 0;
+  deque<IndexedLine> lines;  // never moves its elements, so ids can view them
+  unordered_map<string_view, uint32_t> ids;  // live lines only
+  size_t dead = 0;
+  // Ids of the lines containing each trigram, in increasing order.
+  unordered_map<uint32_t, vector<uint32_t>> postings;
+};
+
+} // namespace
+
+static HistoryIndex& historyIndex() {
+  static HistoryIndex val;
+  return val;
+}
+
+static uint32_t trigramAt(string_view s, size_t i) {
+  return static_cast<uint8_t>(s[i]) << 16 | static_cast<uint8_t>(s[i + 1]) << 8 |
+         static_cast<uint8_t>(s[i + 2]);
+}
+
+static void trigramsOf(string_view s, vector<uint32_t>& grams) {
+  grams.clear();
+  for (size_t i = 0; i + 3 <= s.size(); ++i) grams.push_back(trigramAt(s, i));
+  ranges::sort(grams);
+  grams.erase(ranges::unique(grams).begin(), grams.end());
+}
+
+static void addLine(HistoryIndex& index, string_view line) {
+  uint64_t seq = ++index.seq;
+  if (auto it = index.ids.find(line); it != index.ids.end()) {
+    IndexedLine& known = index.lines[it->second];
+    ++known.count;
+    known.last = seq;
+    return;
+  }
+  auto id = static_cast<uint32_t>(index.lines.size());
+  index.lines.push_back({string(line), 1, seq});
+  index.ids.emplace(index.lines.back().text, id);
+  static vector<uint32_t> grams;
+  trigramsOf(line, grams);
+  for (uint32_t gram : grams) index.postings[gram].push_back(id);
+}
+
+static void buildIndex(HistoryIndex& index) {
+  materializeHistory();
+  index.ids.reserve(history_length);
+  for (int i = 0; i < history_length; ++i) {
+    const HIST_ENTRY* entry = history_get(history_base + i);
+    if (entry && *entry->line) addLine(index, entry->line);
+  }
+  index.built = true;
+}
+
+void indexHistory(string_view line) {
+  HistoryIndex& index = historyIndex();
+  if (index.built && !line.empty()) addLine(index, line);
+}
+
+// A line whose last entry has left the history list keeps its id and
+// postings as a tombstone that searches skip.  Once tombstones outnumber
+// live lines the index is rebuilt from the list, so it stays proportional
+// to HISTSIZE.
+void unindexHistory(string_view line) {
+  HistoryIndex& index = historyIndex();
+  if (!index.built) return;
+  auto it = index.ids.find(line);
+  if (it == index.ids.end()) return;
+  IndexedLine& known = index.lines[it->second];
+  if (--known.count > 0) return;
+  index.ids.erase(it);
+  string().swap(known.text);
+  if (++index.dead > index.ids.size() + kDeadSlack) index = HistoryIndex{};
+}
+
+// Frecency: entry count weighted by the age, in commands, of the latest
+// entry.  Ties go to the more recent line.
+static double rankOf(const IndexedLine& line, uint64_t now) {
+  uint64_t age = now - line.last;
+  double weight = age < 10 ? 100 : age < 100 ? 70 : age < 1000 ? 50 : age < 10000 ? 30 : 10;
+  return line.count * weight;
+}
+
+static vector<uint32_t> candidatesFor(const HistoryIndex& index, string_view pattern) {
+  vector<uint32_t> ids;
+  if (pattern.size() < 3) {
+    ids.resize(index.lines.size());
+    for (uint32_t i = 0; i < ids.size(); ++i) ids[i] = i;
+    return ids;
+  }
+  vector<uint32_t> grams;
+  trigramsOf(pattern, grams);
+  vector<const vector<uint32_t>*> lists;
+  for (uint32_t gram : grams) {
+    auto it = index.postings.find(gram);
+    if (it == index.postings.end()) return ids;
+    lists.push_back(&it->second);
+  }
+  // Intersect starting from the rarest trigram so the working set only
+  // shrinks.
+  ranges::sort(lists, {}, [](const auto* list) { return list->size(); });
+  ids = *lists[0];
+  vector<uint32_t> next;
+  for (size_t i = 1; i < lists.size() && !ids.empty(); ++i) {
+    next.clear();
+    ranges::set_intersection(ids, *lists[i], back_inserter(next));
+    ids.swap(next);
+  }
+  return ids;
+}
+
+vector<string> searchHistory(string_view pattern, size_t limit) {
+  HistoryIndex& index = historyIndex();
+  if (!index.built) buildIndex(index);
+
+  vector<pair<double, uint32_t>> ranked;
+  for (uint32_t id : candidatesFor(index, pattern)) {
+    const IndexedLine& line = index.lines[id];
+    if (line.count > 0 && line.text.find(pattern) != string::npos) ranked.emplace_back(rankOf(line, index.seq), id);
+  }
+  auto better = [&](const auto& a, const auto& b) {
+    if (a.first != b.first) return a.first > b.first;
+    return index.lines[a.second].last > index.lines[b.second].last;
+  };
+  size_t n = min(limit, ranked.size());
+  ranges::partial_sort(ranked, ranked.begin() + n, better);
+
+  vector<string> out;
+  out.reserve(n);
+  for (size_t i = 0; i < n; ++i) out.push_back(index.lines[ranked[i].second].text);
+  return out;
+}
+
+// A failed search leaves the last match on the line, as readline's own
+// incremental search does.
+static void showSearch(const string& pattern, const vector<string>& matches, size_t pick) {
+  if (pick < matches.size()) {
+    rl_replace_line(matches[pick].c_str(), 0);
+    rl_point = static_cast<int>(matches[pick].size());
+  }
+  const char* failed = !pattern.empty() && matches.empty() ? "failing " : "";
+  rl_message("(%sindex-search)`%s': ", failed, pattern.c_str());
+  rl_redisplay();
+}
+
+int historySearchWidget(int, int) {
+  string saved(rl_line_buffer, rl_end);
+  int saved_point = rl_point;
+  string pattern;
+  vector<string> matches;
+  size_t pick = 0;
+  showSearch(pattern, matches, pick);
+  while (true) {
+    int c = rl_read_key();
+    if (c == CTRL('G') || c == EOF) {
+      rl_replace_line(saved.c_str(), 0);
+      rl_point = saved_point;
+      break;
+    }
+    if (c == CTRL('R')) {
+      if (pick + 1 < matches.size()) ++pick;
+      else rl_ding();
+    } else if (c == RUBOUT || c == CTRL('H')) {
+      if (!pattern.empty()) pattern.pop_back();
+      matches = pattern.empty() ? vector<string>{} : searchHistory(pattern, kWidgetMatches);
+      pick = 0;
+    } else if (c == '\n' || c == '\r') {
+      rl_clear_message();
+      return rl_newline(1, c);
+    } else if (c >= ' ' && c != RUBOUT) {
+      pattern += static_cast<char>(c);
+      matches = searchHistory(pattern, kWidgetMatches);
+      pick = 0;
+    } else {
+      rl_execute_next(c);
+      break;
+    }
+    showSearch(pattern, matches, pick);
+  }
+  rl_clear_message();
+  return 0;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file histsearch.h
+ * @brief Indexed history search: a trigram index over distinct history
+ *        lines behind `history -s` and the C-r search widget.
+ *
+ * The index is built from readline's history on the first search and then
+ * kept current by indexHistory() and unindexHistory() as commands enter
+ * and leave it.  Matches are
+ * ranked by frecency: how often a line was entered, weighted by how
+ * recently it was last entered.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Records one line just added to readline's history.  Does nothing
+ *        until the index has been built by a first search.
+ *
+ * @param[in] line  The history line.
+ */
+void indexHistory(std::string_view line);
+
+/**
+ * @brief Records that one entry of @p line has left readline's history
+ *        (HISTSIZE eviction or HISTCONTROL=erasedups).  The line stops
+ *        matching once no entry of it is left.
+ *
+ * @param[in] line  The history line.
+ */
+void unindexHistory(std::string_view line);
+
+/**
+ * @brief Finds distinct history lines containing @p pattern.
+ *
+ * A pattern of three or more bytes is looked up by intersecting the
+ * posting lists of its trigrams, and only the survivors are compared;
+ * shorter patterns scan the distinct lines.
+ *
+ * @param[in] pattern  Substring to look for; empty matches every line.
+ * @param[in] limit    Maximum number of results.
+ * @return             Matching lines, best ranked first.
+ */
+std::vector<std::string> searchHistory(std::string_view pattern, size_t limit);
+
+/**
+ * @brief Readline command `history-index-search`, bound to C-r: an
+ *        incremental search over searchHistory().  Typing edits the
+ *        pattern, C-r moves to the next match, Enter runs the match, C-g
+ *        restores the original line and any other key accepts the match
+ *        for editing.
+ *
+ * @param[in] count  Readline numeric argument (unused).
+ * @param[in] key    The key that invoked the command (unused).
+ * @return           0, as readline commands do.
+ */
+int historySearchWidget(int count, int key);
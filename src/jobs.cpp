@@ -3,134 +3,538 @@
  * @brief Implementations of background job management functions.
  */
 #include "jobs.h"
+#include "executor.h"
+#include "launch.h"
+#include "reaper.h"
 
 #include <iostream>
 #include <algorithm>
-#include <sys/wait.h>
 #include <cerrno>
-#include <ctime>
+#include <charconv>
+#include <csignal>
+#include <deque>
+#include <cstdlib>
+#include <limits>
+#include <queue>
+#include <string_view>
+#include <fcntl.h>
+#include <termios.h>
 #include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 
 using namespace std;
 
+namespace {
+
+/**
+ * Running job stages as pidfds in one epoll set, so `wait` can sleep until
+ * one of them exits.  A pidfd is closed (leaving the set) once its exit has
+ * been claimed.
+ */
+struct JobWatch {
+  int epoll_fd = -1;
+  unordered_map<pid_t, int> pidfds;
+};
+
+} // namespace
+
+static JobWatch& jobWatch() {
+  static JobWatch val;
+  return val;
+}
+
+static void watchPid(pid_t pid) {
+  JobWatch& watch = jobWatch();
+  if (watch.epoll_fd == -1) watch.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  auto pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+  if (watch.epoll_fd == -1 || pidfd == -1) {
+    if (pidfd != -1) close(pidfd);
+    return;
+  }
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = pidfd;
+  epoll_ctl(watch.epoll_fd, EPOLL_CTL_ADD, pidfd, &event);
+  watch.pidfds[pid] = pidfd;
+}
+
+static void unwatchPid(pid_t pid) {
+  auto& pidfds = jobWatch().pidfds;
+  if (auto it = pidfds.find(pid); it != pidfds.end()) {
+    close(it->second);
+    pidfds.erase(it);
+  }
+}
+
+// Sleeps until a watched job stage exits.  Falls back to the reaper's
+// signalfd when pidfds are unavailable.
+static void waitForJobEvent() {
+  JobWatch& watch = jobWatch();
+  if (watch.pidfds.empty()) { waitForChildEvent(); return; }
+  epoll_event event;
+  while (epoll_wait(watch.epoll_fd, &event, 1, -1) == -1 && errno == EINTR) {}
+}
+
+namespace {
+
+/**
+ * Indexes over bg_jobs().  Job numbers come lowest-first from a min-heap of
+ * released numbers; job numbers and live stage pids map to their slot in
+ * bg_jobs(), and queued jobs wait in a FIFO of job numbers.  Slots only move
+ * in compactJobs(), which rewrites them in the same pass.
+ */
+struct JobIndex {
+  priority_queue<int, vector<int>, greater<>> free_numbers;
+  int next_number = 1;
+  unordered_map<int, size_t> job_slots;
+  unordered_map<pid_t, size_t> pid_slots;
+  deque<int> queue;
+  int running = 0;
+  unordered_set<pid_t> disowned;
+};
+
+/** Terminal state the shell hands to foreground jobs and takes back. */
+struct Terminal {
+  int fd = -1;
+  pid_t shell_pgid = 0;
+  termios modes{};
+};
+
+} // namespace
+
+static JobIndex& jobIndex() {
+  static JobIndex val;
+  return val;
+}
+
+static Terminal& terminal() {
+  static Terminal val;
+  return val;
+}
+
+void initJobControl() {
+  Terminal& term = terminal();
+  if (!isatty(STDIN_FILENO)) return;
+  term.fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+  // Started in the background: wait until our parent gives us the terminal.
+  while (tcgetpgrp(term.fd) != getpgrp()) kill(-getpgrp(), SIGTTIN);
+
+  sigset_t& defaults = childSignalDefaults();
+  for (int sig : {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU}) {
+    signal(sig, SIG_IGN);
+    sigaddset(&defaults, sig);
+  }
+  setpgid(0, 0);
+  term.shell_pgid = getpgrp();
+  tcsetpgrp(term.fd, term.shell_pgid);
+  tcgetattr(term.fd, &term.modes);
+  shell_options().monitor = true;
+}
+
+int foregroundTty() {
+  return shell_options().monitor ? terminal().fd : -1;
+}
+
+void giveTerminalTo(pid_t pgid) {
+  if (foregroundTty() != -1 && pgid > 0) tcsetpgrp(terminal().fd, pgid);
+}
+
+void reclaimTerminal() {
+  Terminal& term = terminal();
+  if (foregroundTty() == -1) return;
+  tcsetpgrp(term.fd, term.shell_pgid);
+  tcsetattr(term.fd, TCSADRAIN, &term.modes);
+}
+
 int nextJobNumber() {
-  int num = 1;
-  while (true) {
-    bool used = false;
-    for (const auto& job : bg_jobs()) {
-      if (job.job_number == num) { used = true; break; }
-    }
-    if (!used) return num;
-    num++;
+  JobIndex& index = jobIndex();
+  if (bg_jobs().empty()) {
+    index.free_numbers = {};
+    index.next_number = 1;
   }
+  if (index.free_numbers.empty()) return index.next_number++;
+  int num = index.free_numbers.top();
+  index.free_numbers.pop();
+  return num;
 }
 
-void sigchld_handler(int) {
-  int saved_errno = errno;
-  int wstatus;
-  pid_t pid;
-  while ((pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
-    for (auto& job : bg_jobs()) {
-      if (job.pid == pid && (WIFEXITED(wstatus) || WIFSIGNALED(wstatus))) {
-        job.done = true;
-        break;
+static BackgroundJob* findJob(int job_number) {
+  const auto& slots = jobIndex().job_slots;
+  auto it = slots.find(job_number);
+  return it == slots.end() ? nullptr : &bg_jobs()[it->second];
+}
+
+static BackgroundJob& addJob(BackgroundJob job) {
+  job.job_number = nextJobNumber();
+  jobIndex().job_slots[job.job_number] = bg_jobs().size();
+  return bg_jobs().emplace_back(move(job));
+}
+
+// Records a freshly launched job's stages as live.
+static void trackStages(BackgroundJob& job) {
+  JobIndex& index = jobIndex();
+  size_t slot = index.job_slots.at(job.job_number);
+  job.pid = job.pids.back();
+  job.pgid = shell_options().monitor ? max(getpgid(job.pids.front()), 0) : 0;
+  for (pid_t pid : job.pids) {
+    index.pid_slots[pid] = slot;
+    watchPid(pid);
+  }
+  job.live = (int)job.pids.size();
+  ++index.running;
+}
+
+static void finishStage(BackgroundJob& job, pid_t pid, int wstatus) {
+  if (pid == job.pid) job.status = exitStatusOf(wstatus);
+  unwatchPid(pid);
+  jobIndex().pid_slots.erase(pid);
+  if (--job.live == 0) {
+    job.done = true;
+    --jobIndex().running;
+  }
+}
+
+// Drops every job matching @p drop in one pass, keeping the rest in order
+// and rewriting the slots of those that move.
+template <typename Pred>
+static void compactJobs(Pred drop) {
+  JobIndex& index = jobIndex();
+  vector<BackgroundJob>& jobs = bg_jobs();
+  size_t kept = 0;
+  for (size_t slot = 0; slot < jobs.size(); ++slot) {
+    BackgroundJob& job = jobs[slot];
+    if (drop(job)) {
+      // Stages still running (disown) are no longer ours to report.
+      for (pid_t pid : job.pids) {
+        auto it = index.pid_slots.find(pid);
+        if (it == index.pid_slots.end() || it->second != slot) continue;
+        index.pid_slots.erase(it);
+        index.disowned.insert(pid);
+        unwatchPid(pid);
       }
+      if (job.queued) erase(index.queue, job.job_number);
+      else if (!job.done) --index.running;
+      index.job_slots.erase(job.job_number);
+      index.free_numbers.push(job.job_number);
+      continue;
     }
+    if (kept != slot) {
+      index.job_slots[job.job_number] = kept;
+      for (pid_t pid : job.pids) {
+        auto it = index.pid_slots.find(pid);
+        if (it != index.pid_slots.end() && it->second == slot) it->second = kept;
+      }
+      jobs[kept] = move(job);
+    }
+    ++kept;
   }
-  errno = saved_errno;
+  jobs.erase(jobs.begin() + (ptrdiff_t)kept, jobs.end());
 }
 
-void reapJobs() {
-  vector<int> done_indices;
-  for (int i = 0; i < (int)bg_jobs().size(); i++) {
-    if (!bg_jobs()[i].done) {
-      int wstatus;
-      pid_t result = waitpid(bg_jobs()[i].pid, &wstatus, WNOHANG);
-      if ((result > 0 && (WIFEXITED(wstatus) || WIFSIGNALED(wstatus))) ||
-          (result < 0 && errno == ECHILD)) {
-        bg_jobs()[i].done = true;
-      }
+// Routes recorded exits to the jobs that own them; exits of foreground
+// children stay with the reaper until waitForChild() collects them.
+static void reapTrackedJobs() {
+  reapChildren();
+  JobIndex& index = jobIndex();
+  for (pid_t pid : unclaimedExits()) {
+    int wstatus;
+    auto it = index.pid_slots.find(pid);
+    if (it == index.pid_slots.end()) {
+      if (index.disowned.contains(pid) && claimExit(pid, wstatus) && !WIFSTOPPED(wstatus) && !WIFCONTINUED(wstatus))
+        index.disowned.erase(pid);
+      continue;
     }
-    if (bg_jobs()[i].done) {
-      done_indices.push_back(i);
+    if (!claimExit(pid, wstatus)) continue;
+    BackgroundJob& job = bg_jobs()[it->second];
+    if (WIFSTOPPED(wstatus)) {
+      job.stopped = true;
+      job.status = exitStatusOf(wstatus);
+    } else if (WIFCONTINUED(wstatus)) {
+      job.stopped = false;
+    } else {
+      finishStage(job, pid, wstatus);
     }
   }
-  int n = bg_jobs().size();
-  for (int i = 0; i < n; i++) {
-    if (std::ranges::find(done_indices, i) != done_indices.end()) {
-      const auto& job = bg_jobs()[i];
-      char marker = ' ';
-      if (i == n - 1) marker = '+';
-      else if (i == n - 2) marker = '-';
-      string status_str = "Done";
-      status_str.resize(24, ' ');
-      string cmd = job.command;
-      if (cmd.ends_with(" &")) {
-        cmd = cmd.substr(0, cmd.size() - 2);
-      }
-      cout << "[" << job.job_number << "]" << marker << "  " << status_str << cmd << endl;
+}
+
+static int jobLimit() {
+  string_view value;
+  if (auto it = shell_variables().find("JOBMAX"); it != shell_variables().end()) {
+    value = it->second;
+  } else if (const char* env = getenv("JOBMAX")) {
+    value = env;
+  }
+  int limit = 0;
+  from_chars(value.data(), value.data() + value.size(), limit);
+  return limit > 0 ? limit : numeric_limits<int>::max();
+}
+
+static bool slotsFull() {
+  return jobIndex().running >= jobLimit();
+}
+
+int startBackgroundJob(vector<CommandInfo> commands, string command) {
+  BackgroundJob job;
+  job.job_number = 0;
+  job.pid = 0;
+  job.command = move(command);
+  reapTrackedJobs();
+  if (!jobIndex().queue.empty() || slotsFull()) {
+    job.queued = true;
+    job.pending = move(commands);
+    BackgroundJob& added = addJob(move(job));
+    jobIndex().queue.push_back(added.job_number);
+    cout << "[" << added.job_number << "] queued\n";
+    return 0;
+  }
+  if (int status = launchPipeline(commands, job.pids); status != 0) return status;
+  BackgroundJob& added = addJob(move(job));
+  trackStages(added);
+  cout << "[" << added.job_number << "] " << added.pid << '\n';
+  return 0;
+}
+
+void startQueuedJobs() {
+  // A launch can wait for a child and so come back here through the reap
+  // hook; the outer call goes on with the queue.
+  static bool launching = false;
+  JobIndex& index = jobIndex();
+  if (launching || index.queue.empty()) return;
+  reapTrackedJobs();
+  launching = true;
+  while (!index.queue.empty() && !slotsFull()) {
+    int job_number = index.queue.front();
+    index.queue.pop_front();
+    // The number may since have been freed and reused by a running job.
+    BackgroundJob* job = findJob(job_number);
+    if (!job || !job->queued) continue;
+    vector<CommandInfo> commands = move(job->pending);
+    job->pending.clear();
+    job->queued = false;
+    vector<pid_t> pids;
+    bool launched = launchPipeline(commands, pids) == 0;
+    // Nothing may hold on to the job across the launch: dropping other
+    // jobs moves it.
+    job = findJob(job_number);
+    if (!job) continue;
+    if (launched) {
+      job->pids = move(pids);
+      trackStages(*job);
+    } else {
+      compactJobs([&](const BackgroundJob& j) { return j.job_number == job_number; });
     }
   }
-  for (int i = done_indices.size() - 1; i >= 0; i--) {
-    bg_jobs().erase(bg_jobs().begin() + done_indices[i]);
+  launching = false;
+}
+
+bool jobsQueued() {
+  return !jobIndex().queue.empty();
+}
+
+void drainJobQueue() {
+  while (!jobIndex().queue.empty()) {
+    reapTrackedJobs();
+    if (slotsFull()) waitForJobEvent();
+    startQueuedJobs();
   }
 }
 
-static void pollZombies() {
-  int wstatus;
-  pid_t p;
-  while ((p = waitpid(-1, &wstatus, WNOHANG)) > 0) {
-    for (auto& job : bg_jobs()) {
-      if (job.pid == p && (WIFEXITED(wstatus) || WIFSIGNALED(wstatus))) {
-        job.done = true;
-        break;
-      }
+static void printJob(const BackgroundJob& job, size_t slot, size_t count) {
+  // The two most recently started jobs are current (+) and previous (-).
+  char marker = ' ';
+  if (slot + 1 == count) marker = '+';
+  else if (slot + 2 == count) marker = '-';
+  string status_str = job.done ? "Done" : job.queued ? "Queued" : job.stopped ? "Stopped" : "Running";
+  status_str.resize(24, ' ');
+  string_view cmd = job.command;
+  if (job.done && cmd.ends_with(" &")) cmd.remove_suffix(2);
+  cout << "[" << job.job_number << "]" << marker << "  " << status_str << cmd << '\n';
+}
+
+void reapJobs() {
+  startQueuedJobs();
+  reapTrackedJobs();
+  const vector<BackgroundJob>& jobs = bg_jobs();
+  for (size_t slot = 0; slot < jobs.size(); ++slot) {
+    if (jobs[slot].done) printJob(jobs[slot], slot, jobs.size());
+  }
+  compactJobs([](const BackgroundJob& job) { return job.done; });
+}
+
+void listJobs() {
+  startQueuedJobs();
+  reapTrackedJobs();
+  const vector<BackgroundJob>& jobs = bg_jobs();
+  for (size_t slot = 0; slot < jobs.size(); ++slot) printJob(jobs[slot], slot, jobs.size());
+  compactJobs([](const BackgroundJob& job) { return job.done; });
+}
+
+// Resolves a job operand to a job number, or 0 after printing an error
+// prefixed with @p who.  Accepts %N, %+ / %% (current), %- (previous)
+// and, when @p allow_pid is set, a pid.
+static int resolveJobSpec(string_view who, const string& spec, bool allow_pid = true) {
+  const vector<BackgroundJob>& jobs = bg_jobs();
+  if (spec == "%+" || spec == "%%" || spec == "%-") {
+    size_t back = spec == "%-" ? 2 : 1;
+    if (jobs.size() >= back) return jobs[jobs.size() - back].job_number;
+    cerr << who << ": " << spec << ": no such job" << endl;
+    return 0;
+  }
+  bool is_job = spec.starts_with('%');
+  string_view digits = string_view(spec).substr(is_job ? 1 : 0);
+  int id = 0;
+  auto [end, ec] = from_chars(digits.data(), digits.data() + digits.size(), id);
+  if (ec == errc() && end == digits.data() + digits.size() && (is_job || allow_pid)) {
+    if (is_job && findJob(id)) return id;
+    const auto& pid_slots = jobIndex().pid_slots;
+    if (auto it = pid_slots.find(id); !is_job && it != pid_slots.end()) return jobs[it->second].job_number;
+    // Finished stages have left the pid index.
+    for (const auto& job : jobs) {
+      if (!is_job && ranges::find(job.pids, id) != job.pids.end()) return job.job_number;
     }
   }
+  if (is_job || !allow_pid) cerr << who << ": " << spec << ": no such job" << endl;
+  else                      cerr << who << ": pid " << spec << " is not a child of this shell" << endl;
+  return 0;
 }
 
-static void pollJobWithRetry(BackgroundJob& job) {
-  for (int attempt = 0; attempt < 5; attempt++) {
-    int wstatus;
-    pid_t result = waitpid(job.pid, &wstatus, WNOHANG);
-    bool exited = (result > 0 && (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)));
-    if (bool no_child = (result < 0 && errno == ECHILD); exited || no_child) {
-      job.done = true;
-      break;
+int waitForJobs(const vector<string>& specs, bool any) {
+  vector<int> targets;
+  int status = 0;
+  for (const auto& spec : specs) {
+    if (int job_number = resolveJobSpec("wait", spec)) targets.push_back(job_number);
+    else                                       status = 127;
+  }
+  if (specs.empty()) {
+    for (const auto& job : bg_jobs()) targets.push_back(job.job_number);
+  }
+  if (targets.empty()) return any ? 127 : status;
+
+  while (true) {
+    startQueuedJobs();
+    reapTrackedJobs();
+    bool all_done = true;
+    for (int job_number : targets) {
+      BackgroundJob* job = findJob(job_number);
+      if (!job || !job->done) { all_done = all_done && !job; continue; }
+      if (any) {
+        int job_status = job->status;
+        compactJobs([&](const BackgroundJob& j) { return j.job_number == job_number; });
+        return job_status;
+      }
     }
-    if (attempt < 4) {
-      struct timespec ts = {0, 50000000};
-      nanosleep(&ts, nullptr);
+    if (all_done) {
+      if (any) return 127;
+      break;
     }
+    waitForJobEvent();
   }
+  // Waited-for jobs are not reported again as Done.
+  for (int job_number : targets) {
+    if (BackgroundJob* job = findJob(job_number)) status = job->status;
+  }
+  unordered_set<int> waited(targets.begin(), targets.end());
+  compactJobs([&](const BackgroundJob& job) { return waited.contains(job.job_number); });
+  return specs.empty() ? 0 : status;
 }
 
-void listJobs() {
-  pollZombies();
-  for (auto& job : bg_jobs()) {
-    if (!job.done) pollJobWithRetry(job);
+static string_view displayCommand(const BackgroundJob& job) {
+  string_view cmd = job.command;
+  if (cmd.ends_with(" &")) cmd.remove_suffix(2);
+  return cmd;
+}
+
+// Signals the job's process group, or its live stages one by one when it
+// was started without job control.
+static void signalJob(const BackgroundJob& job, int sig) {
+  if (job.pgid > 0) { kill(-job.pgid, sig); return; }
+  for (const auto& [pid, slot] : jobIndex().pid_slots) {
+    if (bg_jobs()[slot].job_number == job.job_number) kill(pid, sig);
   }
+}
+
+void suspendForeground(vector<pid_t> pids, string command) {
+  if (pids.empty()) return;
+  BackgroundJob job;
+  job.job_number = 0;
+  job.pid = 0;
+  job.command = move(command);
+  job.pids = move(pids);
+  BackgroundJob& added = addJob(move(job));
+  trackStages(added);
+  added.stopped = true;
+  added.status = 128 + SIGTSTP;
+  cout << "\n[" << added.job_number << "]+  Stopped                 " << displayCommand(added) << '\n';
+}
 
-  vector<int> done_indices;
-  for (int i = 0; i < (int)bg_jobs().size(); i++) {
-    if (bg_jobs()[i].done) done_indices.push_back(i);
+int resumeJob(const string& spec, bool foreground) {
+  string_view who = foreground ? "fg" : "bg";
+  if (foregroundTty() == -1) { cerr << who << ": no job control" << endl; return 1; }
+  int job_number = resolveJobSpec(who, spec.empty() ? "%+" : spec, false);
+  BackgroundJob* job = findJob(job_number);
+  if (!job) return 1;
+  if (job->queued) { cerr << who << ": %" << job_number << ": job has not started" << endl; return 1; }
+  if (job->done)   { cerr << who << ": %" << job_number << ": job has terminated" << endl; return 1; }
+
+  if (!foreground) {
+    if (!job->stopped) { cerr << "bg: job " << job_number << " already in background" << endl; return 0; }
+    job->stopped = false;
+    signalJob(*job, SIGCONT);
+    if (!job->command.ends_with(" &")) job->command += " &";
+    cout << "[" << job_number << "]+ " << job->command << '\n';
+    return 0;
   }
 
-  int n = bg_jobs().size();
-  for (int i = 0; i < n; i++) {
-    const auto& job = bg_jobs()[i];
-    char marker = ' ';
-    if (i == n - 1) marker = '+';
-    else if (i == n - 2) marker = '-';
-    bool is_done = std::ranges::find(done_indices, i) != done_indices.end();
-    string status_str = is_done ? "Done" : "Running";
-    status_str.resize(24, ' ');
-    string cmd = is_done && job.command.ends_with(" &")
-                   ? job.command.substr(0, job.command.size() - 2)
-                   : job.command;
-    cout << "[" << job.job_number << "]" << marker << "  " << status_str << cmd << endl;
+  cout << displayCommand(*job) << '\n';
+  cout.flush();
+  giveTerminalTo(job->pgid);
+  if (job->stopped) {
+    job->stopped = false;
+    signalJob(*job, SIGCONT);
+  }
+  // Stops are only reported through SIGCHLD, so sleep on the reaper's fd
+  // rather than the exit-only pidfds.
+  while (true) {
+    reapTrackedJobs();
+    job = findJob(job_number);
+    if (job->done || job->stopped) break;
+    waitForChildEvent();
   }
-  for (int i = done_indices.size() - 1; i >= 0; i--) {
-    bg_jobs().erase(bg_jobs().begin() + done_indices[i]);
+  reclaimTerminal();
+  int status = job->status;
+  if (job->stopped) {
+    cout << "\n[" << job_number << "]+  Stopped                 " << displayCommand(*job) << '\n';
+  } else {
+    compactJobs([&](const BackgroundJob& j) { return j.job_number == job_number; });
+  }
+  return status;
+}
+
+int killJob(const string& spec, int sig) {
+  int job_number = resolveJobSpec("kill", spec, false);
+  BackgroundJob* job = findJob(job_number);
+  if (!job) return 1;
+  if (job->queued) {
+    compactJobs([&](const BackgroundJob& j) { return j.job_number == job_number; });
+    return 0;
+  }
+  signalJob(*job, sig);
+  // A stopped job only acts on the signal once it runs again.
+  if (job->stopped && sig != SIGSTOP && sig != SIGTSTP && sig != SIGCONT) signalJob(*job, SIGCONT);
+  return 0;
+}
+
+int disownJobs(const vector<string>& specs) {
+  int status = 0;
+  unordered_set<int> targets;
+  for (const auto& spec : specs.empty() ? vector<string>{"%+"} : specs) {
+    if (int job_number = resolveJobSpec("disown", spec)) targets.insert(job_number);
+    else                                                 status = 1;
   }
+  compactJobs([&](const BackgroundJob& job) { return targets.contains(job.job_number); });
+  return status;
 }
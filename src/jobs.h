@@ -1,25 +1,54 @@
 /**
  * @file jobs.h
- * @brief Background job management: reaping, tracking, and SIGCHLD handling.
+ * @brief Background job management: tracking, job slots and completion
+ *        reporting.  Exits are collected by the reaper (see reaper.h).
+ *
+ * At most JOBMAX background jobs run at once (a shell variable, falling back
+ * to the environment; unset or ≤ 0 means unlimited).  Further jobs wait in
+ * FIFO order and are started as soon as a reaped job frees a slot.
  */
 #pragma once
 
 #include "globals.h"
 
+#include <string>
+#include <vector>
+
 /**
- * @brief Returns the lowest positive integer not already in use as a job number.
+ * @brief Claims the lowest positive integer not already in use as a job
+ *        number.  Numbers return to a min-heap when their job leaves the
+ *        table, so this is O(log n).
  *
  * @return The next available job number (≥ 1).
  */
 int nextJobNumber();
 
 /**
- * @brief SIGCHLD handler that non-blockingly reaps exited background children
- *        and marks matching bg_jobs entries as done.  Safe for use with SA_RESTART.
+ * @brief Starts @p commands as a background job, or queues it if every job
+ *        slot is taken.  Prints `[N] pid` for a started job (pid of the
+ *        last stage) or `[N] queued`.
  *
- * @param sig  Signal number (always SIGCHLD; not used).
+ * @param[in] commands  Expanded pipeline stages.
+ * @param[in] command   Command text recorded for `jobs`.
+ * @return              0 on success, or the launch failure status.
+ */
+int startBackgroundJob(std::vector<CommandInfo> commands, std::string command);
+
+/**
+ * @brief Launches queued jobs, oldest first, while job slots are free.
+ *        Cheap when nothing is queued; runs whenever the reaper reports a
+ *        child exit, both at the prompt and during foreground waits.
  */
-void sigchld_handler(int sig);
+void startQueuedJobs();
+
+/** @brief True while any background job waits for a free job slot. */
+bool jobsQueued();
+
+/**
+ * @brief Blocks until every queued job has been launched.  Used when a
+ *        script ends so that no queued work is silently dropped.
+ */
+void drainJobQueue();
 
 /**
  * @brief Reaps all completed background jobs, prints their completion status
@@ -29,9 +58,89 @@ void sigchld_handler(int sig);
 void reapJobs();
 
 /**
- * @brief Implements the `jobs` builtin: performs a non-blocking reap pass,
- *        then prints every job in `[N]+/-  Status   command` format
- *        (Status is "Running" or "Done") and removes completed entries
- *        from bg_jobs.
+ * @brief Implements the `jobs` builtin: collects pending exits without
+ *        blocking, then prints every job in `[N]+/-  Status   command`
+ *        format (Status is "Running", "Queued" or "Done") and removes
+ *        completed entries from bg_jobs.
  */
 void listJobs();
+
+/**
+ * @brief Implements the `wait` builtin.  Sleeps on the jobs' pidfds (an
+ *        epoll set) rather than polling.  Jobs waited for are removed from
+ *        bg_jobs without a Done report.
+ *
+ * @param[in] specs  `%N` job specs or pids; empty means every job.
+ * @param[in] any    `-n`: return as soon as any one of the jobs finishes.
+ * @return           Status of the last job waited for; 0 with no @p specs;
+ *                   127 if an operand names no job (or `-n` had none).
+ */
+int waitForJobs(const std::vector<std::string>& specs, bool any);
+
+/**
+ * @brief Enables job control when stdin is a terminal: puts the shell in
+ *        its own process group, takes the terminal, ignores the
+ *        job-control signals (children get them back, see launch.h) and
+ *        turns on `set -o monitor`.
+ */
+void initJobControl();
+
+/**
+ * @brief Terminal to hand to foreground jobs.
+ *
+ * @return Its descriptor, or -1 when job control is off.
+ */
+int foregroundTty();
+
+/**
+ * @brief Makes @p pgid the terminal's foreground process group (no-op
+ *        without job control).
+ *
+ * @param[in] pgid  Process group of the job being run in the foreground.
+ */
+void giveTerminalTo(pid_t pgid);
+
+/**
+ * @brief Takes the terminal back for the shell and restores the terminal
+ *        modes saved at startup, which the job may have changed.
+ */
+void reclaimTerminal();
+
+/**
+ * @brief Turns the stopped stages of a foreground pipeline into a stopped
+ *        job and prints `[N]+  Stopped   command`.
+ *
+ * @param[in] pids     Stopped stage pids; empty does nothing.
+ * @param[in] command  Command text recorded for `jobs`.
+ */
+void suspendForeground(std::vector<pid_t> pids, std::string command);
+
+/**
+ * @brief Implements `fg` / `bg`: continues a job, in the foreground (with
+ *        the terminal, waiting until it exits or stops again) or in the
+ *        background.
+ *
+ * @param[in] spec        Job spec (%N, %+, %-); empty means the current job.
+ * @param[in] foreground  true for `fg`, false for `bg`.
+ * @return                `fg`: the job's status; `bg`: 0; 1 on error.
+ */
+int resumeJob(const std::string& spec, bool foreground);
+
+/**
+ * @brief Sends @p sig to every process of the job named by @p spec.  A
+ *        stopped job is continued so it can act on the signal; a queued
+ *        job is simply dropped.
+ *
+ * @param[in] spec  Job spec (%N, %+, %-).
+ * @param[in] sig   Signal number.
+ * @return          0 on success, 1 if there is no such job.
+ */
+int killJob(const std::string& spec, int sig);
+
+/**
+ * @brief Implements `disown`: forgets jobs without signalling them.
+ *
+ * @param[in] specs  Job specs or pids; empty means the current job.
+ * @return           0, or 1 if an operand names no job.
+ */
+int disownJobs(const std::vector<std::string>& specs);
@@ -0,0 +1,193 @@
+/**
+ * @file launch.cpp
+ * @brief Implementation of the posix_spawn() launch engine.
+ */
+#include "launch.h"
+#include "reaper.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string_view>
+#include <spawn.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace std;
+
+extern char** environ;
+
+sigset_t& childSignalDefaults() {
+  static sigset_t val = [] {
+    sigset_t set;
+    sigemptyset(&set);
+    return set;
+  }();
+  return val;
+}
+
+static int openRedirect(const string& file, bool append) {
+  TraceSpan span("redirect", file);
+  int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+  int fd = open(file.c_str(), flags, 0666);
+  if (fd == -1) cerr << "Failed to open " << file << " for writing" << endl;
+  return fd;
+}
+
+static vector<char*> buildArgv(const vector<string>& args) {
+  vector<char*> argv;
+  argv.reserve(args.size() + 1);
+  for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+  return argv;
+}
+
+// environ with io.env layered on top; the strings stay owned by their
+// sources.
+static vector<char*> buildEnvp(const SpawnIO& io) {
+  if (io.env.empty()) return {};
+  vector<char*> envp;
+  for (char** var = environ; *var; ++var) {
+    string_view entry(*var);
+    string_view name = entry.substr(0, entry.find('='));
+    bool replaced = any_of(io.env.begin(), io.env.end(), [&](const string& extra) {
+      return extra.size() > name.size() && extra[name.size()] == '=' && extra.starts_with(name);
+    });
+    if (!replaced) envp.push_back(*var);
+  }
+  for (const auto& extra : io.env) envp.push_back(const_cast<char*>(extra.c_str()));
+  envp.push_back(nullptr);
+  return envp;
+}
+
+// posix_spawn() has no hook for setrlimit(), so a limited launch forks and
+// installs the limits in the child.  A close-on-exec pipe carries a failed
+// setrlimit() or exec back to the parent.
+static pid_t forkWithLimits(const string& path, vector<char*>& argv, char** envp,
+                            const SpawnIO& io, int out_fd, int err_fd) {
+  TraceSpan span("fork", argv[0]);
+  int report[2];
+  if (pipe2(report, O_CLOEXEC) == -1) return -1;
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(report[0]);
+    if (io.pgid >= 0) setpgid(0, io.pgid);
+    if (io.tty_fd != -1 && io.pgid == 0) tcsetpgrp(io.tty_fd, getpgrp());
+    if (io.stdin_fd != -1)  dup2(io.stdin_fd, STDIN_FILENO);
+    if (io.stdout_fd != -1) dup2(io.stdout_fd, STDOUT_FILENO);
+    if (out_fd != -1)       dup2(out_fd, STDOUT_FILENO);
+    if (err_fd != -1)       dup2(err_fd, STDERR_FILENO);
+    for (int sig = 1; sig < NSIG; ++sig) {
+      if (sigismember(&childSignalDefaults(), sig) == 1) signal(sig, SIG_DFL);
+    }
+    sigprocmask(SIG_SETMASK, &childSignalMask(), nullptr);
+    int err = 0;
+    for (const auto& limit : io.limits) {
+      if (setrlimit(limit.resource, &limit.limit) != 0) { err = errno; break; }
+    }
+    if (err == 0) {
+      execve(path.c_str(), argv.data(), envp);
+      err = errno;
+    }
+    ssize_t ignored = write(report[1], &err, sizeof err);
+    (void)ignored;
+    _exit(127);
+  }
+  close(report[1]);
+  if (pid > 0) {
+    if (io.pgid >= 0) setpgid(pid, io.pgid == 0 ? pid : io.pgid);
+    int err = 0;
+    ssize_t n;
+    while ((n = read(report[0], &err, sizeof err)) == -1 && errno == EINTR) {}
+    if (n > 0) {
+      int wstatus;
+      waitForExit(pid, wstatus);
+      pid = -1;
+    }
+  }
+  close(report[0]);
+  return pid;
+}
+
+pid_t spawnProgram(const string& path, const vector<string>& args, const SpawnIO& io) {
+  cout.flush();
+  int out_fd = -1;
+  int err_fd = -1;
+  if (!io.output_file.empty() && (out_fd = openRedirect(io.output_file, io.is_append)) == -1)
+    return -1;
+  if (!io.error_file.empty() && (err_fd = openRedirect(io.error_file, io.is_error_append)) == -1) {
+    if (out_fd != -1) close(out_fd);
+    return -1;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 35)
+  // Taking the terminal in the child closes the window in which a new
+  // foreground job could read it before the shell's tcsetpgrp() lands.
+  if (io.tty_fd != -1 && io.pgid == 0) posix_spawn_file_actions_addtcsetpgrp_np(&actions, io.tty_fd);
+#endif
+  if (io.stdin_fd != -1)  posix_spawn_file_actions_adddup2(&actions, io.stdin_fd, STDIN_FILENO);
+  if (io.stdout_fd != -1) posix_spawn_file_actions_adddup2(&actions, io.stdout_fd, STDOUT_FILENO);
+  if (out_fd != -1)       posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+  if (err_fd != -1)       posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+
+  // The shell keeps SIGCHLD blocked for its reaper; children start without.
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &childSignalMask());
+  posix_spawnattr_setsigdefault(&attr, &childSignalDefaults());
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  if (io.pgid >= 0) {
+    posix_spawnattr_setpgroup(&attr, io.pgid);
+    flags |= POSIX_SPAWN_SETPGROUP;
+  }
+  posix_spawnattr_setflags(&attr, flags);
+
+  TraceSpan span("spawn", args[0]);
+  vector<char*> argv = buildArgv(args);
+  vector<char*> envp = buildEnvp(io);
+  char** env = envp.empty() ? environ : envp.data();
+  pid_t pid = -1;
+  int rc = 0;
+  if (io.limits.empty()) rc = posix_spawn(&pid, path.c_str(), &actions, &attr, argv.data(), env);
+  else if ((pid = forkWithLimits(path, argv, env, io, out_fd, err_fd)) == -1) rc = -1;
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  if (out_fd != -1) close(out_fd);
+  if (err_fd != -1) close(err_fd);
+
+  if (rc != 0) {
+    cerr << "Failed to execute " << path << endl;
+    return -1;
+  }
+  return pid;
+}
+
+static bool redirectInPlace(const string& file, bool append, int target) {
+  if (file.empty()) return true;
+  int fd = openRedirect(file, append);
+  if (fd == -1) return false;
+  dup2(fd, target);
+  close(fd);
+  return true;
+}
+
+void execInPlace(const string& path, const vector<string>& args, const SpawnIO& io) {
+  cout.flush();
+  cerr.flush();
+  if (!redirectInPlace(io.output_file, io.is_append, STDOUT_FILENO) ||
+      !redirectInPlace(io.error_file, io.is_error_append, STDERR_FILENO) ||
+      !applyLimits(io.limits)) {
+    return;
+  }
+  vector<char*> argv = buildArgv(args);
+  for (int sig = 1; sig < NSIG; ++sig) {
+    if (sigismember(&childSignalDefaults(), sig) == 1) signal(sig, SIG_DFL);
+  }
+  sigprocmask(SIG_SETMASK, &childSignalMask(), nullptr);
+  execv(path.c_str(), argv.data());
+  cerr << "Failed to execute " << path << endl;
+}
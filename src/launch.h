@@ -0,0 +1,96 @@
+/**
+ * @file launch.h
+ * @brief Process launch engine built on posix_spawn().
+ *
+ * glibc implements posix_spawn() with clone(CLONE_VM | CLONE_VFORK), so the
+ * child borrows the shell's address space until it execs instead of copying
+ * its page tables the way fork() does.  All fd plumbing is expressed as
+ * spawn file actions.  fork() remains only for built-ins that must run in a
+ * child process and for launches with per-command resource limits, which
+ * posix_spawn() cannot install.
+ */
+#pragma once
+
+#include "rlimits.h"
+
+#include <csignal>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @brief Describes how a spawned child's standard streams are wired.
+ *
+ * @var SpawnIO::stdin_fd         Descriptor dup'd onto fd 0, or -1 to inherit.
+ * @var SpawnIO::stdout_fd        Descriptor dup'd onto fd 1, or -1 to inherit.
+ * @var SpawnIO::output_file      Redirect stdout to this path; empty = none.
+ *                                Applied after @p stdout_fd, so it wins.
+ * @var SpawnIO::is_append        Open @p output_file with O_APPEND.
+ * @var SpawnIO::error_file       Redirect stderr to this path; empty = none.
+ * @var SpawnIO::is_error_append  Open @p error_file with O_APPEND.
+ * @var SpawnIO::pgid             Process group to join: 0 starts a new group
+ *                                led by the child, -1 stays in the shell's.
+ * @var SpawnIO::tty_fd           Terminal to hand to the child's new group
+ *                                before it execs, or -1.  Needs @p pgid 0.
+ * @var SpawnIO::env              Extra `NAME=value` entries for the child's
+ *                                environment; each replaces an inherited
+ *                                variable of the same name.
+ * @var SpawnIO::limits           Resource limits set in the child before it
+ *                                execs (`ulimit ... -- cmd`).
+ */
+struct SpawnIO {
+  int stdin_fd = -1;
+  int stdout_fd = -1;
+  std::string output_file;
+  bool is_append = false;
+  std::string error_file;
+  bool is_error_append = false;
+  pid_t pgid = -1;
+  int tty_fd = -1;
+  std::vector<std::string> env = {};
+  std::vector<ResourceLimit> limits;
+};
+
+/**
+ * @brief Signals every spawned child resets to SIG_DFL: the job-control
+ *        signals an interactive shell ignores, since ignored dispositions
+ *        survive exec.  Empty until job control is enabled.
+ */
+sigset_t& childSignalDefaults();
+
+/**
+ * @brief Launches @p path with @p args using posix_spawn().
+ *
+ * Redirect targets are opened in the shell (close-on-exec) and handed to the
+ * child as dup2 file actions, so open failures are reported without ever
+ * creating a process.  Descriptors the caller wants hidden from the child
+ * must be close-on-exec (e.g. created with pipe2(O_CLOEXEC)).
+ *
+ * @param[in] path  Absolute path to the executable.
+ * @param[in] args  Argument list; args[0] is the program name.
+ * @param[in] io    Standard-stream wiring for the child.
+ * @return          The child's pid, or -1 after printing an error.
+ *
+ * Pending std::cout output is flushed first so it cannot be reordered
+ * behind the child's.
+ */
+pid_t spawnProgram(const std::string& path,
+                   const std::vector<std::string>& args,
+                   const SpawnIO& io = {});
+
+/**
+ * @brief Replaces the shell image with @p path (no new process).  Used for
+ *        the last command of a `-c` string, where the shell would otherwise
+ *        just wait and exit.  Only @p io's file redirects and limits are
+ *        honoured.
+ *
+ * @param[in] path  Absolute path to the executable.
+ * @param[in] args  Argument list; args[0] is the program name.
+ * @param[in] io    Redirects to apply before the exec.
+ *
+ * Returns only if a redirect cannot be opened, a limit cannot be set or
+ * the exec fails, after printing an error.
+ */
+void execInPlace(const std::string& path,
+                 const std::vector<std::string>& args,
+                 const SpawnIO& io = {});
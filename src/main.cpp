@@ -3,49 +3,96 @@
  * @brief A POSIX-compatible interactive shell - REPL entry point.
  *
  * All subsystems are in their own modules:
- *   globals.h/cpp      - shared state and built-in name table
- *   jobs.h/cpp         - background-job tracking and SIGCHLD handling
- *   parser.h/cpp       - command-line tokeniser and pipeline parser
- *   executor.h/cpp     - built-in / external command execution
+ *   globals.h/cpp      - shared shell state
+ *   jobs.h/cpp         - job table, job slots and job control
+ *   reaper.h/cpp       - signalfd-driven reaping of every child process
+ *   parser.h/cpp       - single-pass command-list / pipeline parser
+ *   builtins.h/cpp     - built-in command table and implementations
+ *   executor.h/cpp     - external command and pipeline execution
+ *   histfile.h/cpp     - locked, append-only HISTFILE persistence
+ *   histlist.h/cpp     - HISTSIZE-bounded in-memory history and HISTCONTROL
+ *   histsearch.h/cpp   - trigram-indexed history search (`history -s`, C-r)
+ *   launch.h/cpp       - posix_spawn() process launch engine
+ *   rlimits.h/cpp      - resource limits behind `ulimit` and `ulimit ... --`
+ *   script.h/cpp       - chunked input for -c, script and piped-stdin modes
+ *   timing.h/cpp       - wait4()/rusage accounting behind `time` and `times`
+ *   trace.h/cpp        - opt-in phase tracing with Chrome trace-event export
+ *   pathcache.h/cpp    - hashed PATH lookup, completion index and prewarming
  *   completion.h/cpp   - GNU Readline tab-completion hooks
  */
 
 #include "globals.h"
+#include "builtins.h"
 #include "jobs.h"
+#include "reaper.h"
 #include "parser.h"
 #include "executor.h"
+#include "histfile.h"
+#include "histlist.h"
+#include "histsearch.h"
+#include "launch.h"
+#include "pathcache.h"
+#include "script.h"
+#include "timing.h"
+#include "trace.h"
 #include "completion.h"
 
 #include <iostream>
 #include <string>
-#include <fstream>
 #include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <algorithm>
 #include <memory>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 using namespace std;
 
-static void initShell() {
-  cout << unitbuf;
-  cerr << unitbuf;
-  rl_attempted_completion_function = command_completion;
+// Waits for a key while servicing the reaper, so finished jobs are
+// collected and queued jobs started as soon as SIGCHLD arrives at the prompt.
+// History entries deferred at startup are handed to readline the first time
+// the user pauses, or at once if they are about to scroll past the oldest
+// entry readline has.
+static int readKey(FILE* stream) {
+  if (historyDeferred() && where_history() == 0) materializeHistory();
+  pollfd fds[2] = {{fileno(stream), POLLIN, 0}, {reaperFd(), POLLIN, 0}};
+  int ready;
+  while ((ready = poll(fds, 2, historyDeferred() ? 50 : -1)) >= 0 && fds[0].revents == 0) {
+    if (ready == 0) { materializeHistory(); continue; }
+    reapChildren();
+    startQueuedJobs();
+  }
+  return rl_getc(stream);
+}
+
+static void initShell(bool interactive) {
+  if (interactive) {
+    cout << unitbuf;
+    cerr << unitbuf;
+    rl_getc_function = readKey;
+    rl_attempted_completion_function = command_completion;
+    rl_add_defun("history-index-search", historySearchWidget, CTRL('R'));
 #ifdef __APPLE__
-  // macOS readline headers type this as VFunction* (void(*)()) — cast required.
-  rl_completion_display_matches_hook = reinterpret_cast<VFunction*>(display_matches_hook);
+    // macOS readline headers type this as VFunction* (void(*)()) — cast required.
+    rl_completion_display_matches_hook = reinterpret_cast<VFunction*>(display_matches_hook);
 #else
-  // Linux/GCC: typed as rl_compdisp_func_t* (void(*)(char**,int,int)) — plain assignment.
-  rl_completion_display_matches_hook = display_matches_hook;
+    // Linux/GCC: typed as rl_compdisp_func_t* (void(*)(char**,int,int)) — plain assignment.
+    rl_completion_display_matches_hook = display_matches_hook;
 #endif
-  struct sigaction sa;
-  sa.sa_handler = sigchld_handler;
-  sigemptyset(&sa.sa_mask);
-  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-  sigaction(SIGCHLD, &sa, nullptr);
+  } else {
+    // Scripts: fully buffered stdout, flushed before every spawn/fork.
+    setvbuf(stdout, nullptr, _IOFBF, 64 * 1024);
+  }
+  traceInit();
+  initReaper();
+  setReapHook(startQueuedJobs);
+  if (interactive) initJobControl();
 }
 
 static string getHistfile() {
@@ -55,211 +102,68 @@ static string getHistfile() {
 
 static void loadHistory(const string& histfile) {
   if (histfile.empty()) return;
-  ifstream file(histfile);
-  if (!file.is_open()) return;
-  string line;
-  while (getline(file, line)) {
-    if (!line.empty()) add_history(line.c_str());
-  }
-}
-
-static void saveHistory(const string& histfile) {
-  if (histfile.empty()) return;
-  ofstream file(histfile);
-  if (!file.is_open()) return;
-  for (int i = history_base; i < history_base + history_length; ++i) {
-    const HIST_ENTRY* entry = history_get(i);
-    if (entry) file << entry->line << endl;
-  }
-}
-
-static void runEcho(const vector<string>& args) {
-  for (size_t i = 1; i < args.size(); ++i) {
-    if (i > 1) cout << " ";
-    cout << args[i];
-  }
-  cout << endl;
-}
-
-static void runType(const vector<string>& args) {
-  if (args.size() <= 1) return;
-  const string& arg = args[1];
-  if (isBuiltin(arg)) { cout << arg << " is a shell builtin" << endl; return; }
-  string path = findInPath(arg);
-  if (!path.empty()) cout << arg << " is " << path << endl;
-  else               cout << arg << ": not found" << endl;
-}
-
-static void runPwd() {
-  string cwd(1024, '\0');
-  if (getcwd(cwd.data(), cwd.size()) != nullptr) cout << cwd.c_str() << endl;
-  else cerr << "pwd: error getting current directory" << endl;
+  TraceSpan span("history", "load");
+  loadHistoryFile(histfile);
 }
 
-static void runHistoryRead(const string& filename) {
-  ifstream file(filename);
-  if (!file.is_open()) { cerr << "history: " << filename << ": No such file or directory" << endl; return; }
-  string line;
-  while (getline(file, line)) {
-    if (!line.empty()) add_history(line.c_str());
-  }
-}
-
-static void runHistoryAppend(const string& filename) {
-  ofstream file(filename, ios::app);
-  if (!file.is_open()) { cerr << "history: " << filename << ": cannot create" << endl; return; }
-  int start = (last_appended_index() == -1) ? history_base : last_appended_index() + 1;
-  int end = history_base + history_length;
-  for (int i = start; i < end; ++i) {
-    const HIST_ENTRY* entry = history_get(i);
-    if (entry) file << entry->line << endl;
-  }
-  last_appended_index() = (history_base + history_length) - 1;
-}
-
-static void runHistoryWrite(const string& filename) {
-  ofstream file(filename);
-  if (!file.is_open()) { cerr << "history: " << filename << ": cannot create" << endl; return; }
-  for (int i = history_base; i < history_base + history_length; ++i) {
-    const HIST_ENTRY* entry = history_get(i);
-    if (entry) file << entry->line << endl;
-  }
-}
-
-static void runHistoryList(const vector<string>& args) {
-  int end = history_base + history_length;
-  int start = history_base;
-  if (args.size() > 1 && args[1] != "-r" && args[1] != "-w" && args[1] != "-a") {
-    start = max(history_base, end - stoi(args[1]));
-  }
-  for (int i = start; i < end; ++i) {
-    const HIST_ENTRY* entry = history_get(i);
-    if (entry) cout << "    " << i << "  " << entry->line << endl;
-  }
-}
-
-static void runHistory(const vector<string>& args) {
-  if (args.size() > 2 && args[1] == "-r") { runHistoryRead(args[2]);   return; }
-  if (args.size() > 2 && args[1] == "-a") { runHistoryAppend(args[2]); return; }
-  if (args.size() > 2 && args[1] == "-w") { runHistoryWrite(args[2]);  return; }
-  runHistoryList(args);
-}
-
-static void runComplete(const vector<string>& args) {
-  if (args.size() > 3 && args[1] == "-C") { completion_registry()[args[3]] = args[2]; return; }
-  if (args.size() > 2 && args[1] == "-r") { completion_registry().erase(args[2]);     return; }
-  if (args.size() > 2 && args[1] == "-p") {
-    const string& cmd = args[2];
-    auto it = completion_registry().find(cmd);
-    if (it != completion_registry().end()) cout << "complete -C '" << it->second << "' " << cmd << endl;
-    else cerr << "complete: " << cmd << ": no completion specification" << endl;
-  }
-}
-
-static void runDeclareShow(const string& varname) {
-  auto it = shell_variables().find(varname);
-  if (it != shell_variables().end()) cout << "declare -- " << it->first << "=\"" << it->second << "\"" << endl;
-  else cerr << "declare: " << varname << ": not found" << endl;
-}
-
-static void runDeclareSet(const string& assignment) {
-  size_t eq = assignment.find('=');
-  if (eq == string::npos) return;
-  string varname = assignment.substr(0, eq);
-  bool valid = !varname.empty()
-    && (isalpha(static_cast<unsigned char>(varname[0])) || varname[0] == '_')
-    && all_of(varname.begin() + 1, varname.end(),
-              [](unsigned char c){ return isalnum(c) || c == '_'; });
-  if (!valid) cerr << "declare: `" << assignment << "': not a valid identifier" << endl;
-  else        shell_variables()[varname] = assignment.substr(eq + 1);
-}
-
-static void runDeclare(const vector<string>& args) {
-  if (args.size() > 1 && args[1] == "-p") {
-    if (args.size() > 2) runDeclareShow(args[2]);
-    return;
-  }
-  if (args.size() > 1) runDeclareSet(args[1]);
-}
-
-static void runCd(const vector<string>& args) {
-  if (args.size() <= 1) return;
-  string path = args[1];
-  if (path == "~" || path.starts_with("~/")) {
-    const char* home_env = getenv("HOME");
-    if (home_env) {
-      string home = home_env;
-      path = (path == "~") ? home : home + path.substr(1);
-    }
-  }
-  if (chdir(path.c_str()) != 0) cout << "cd: " << path << ": No such file or directory" << endl;
-}
-
-static void runBackground(const string& program, const vector<string>& args, const string& command) {
-  string path = findInPath(program);
-  if (path.empty()) { cout << program << ": command not found" << endl; return; }
-  pid_t pid = fork();
-  if (pid == 0) {
-    vector<vector<char>> argv_storage;
-    vector<char*> argv;
-    argv_storage.reserve(args.size());
-    argv.reserve(args.size() + 1);
-    for (const auto& arg : args) {
-      argv_storage.emplace_back(arg.begin(), arg.end());
-      argv_storage.back().push_back('\0');
-      argv.push_back(argv_storage.back().data());
+/**
+ * Strips a `ulimit [options] --` launch prefix off the first stage of
+ * @p commands and hands its limits to every stage.  Returns 0 to go ahead,
+ * or the status to fail with: 2 for a bad prefix, 1 when a stage is a
+ * built-in, which would run inside the shell and escape the limits.
+ */
+static int takePipelineLimits(vector<CommandInfo>& commands) {
+  vector<ResourceLimit> limits;
+  int taken = takeLimitPrefix(commands[0].args, limits);
+  if (taken <= 0) return taken < 0 ? 2 : 0;
+  for (auto& cmd : commands) {
+    if (!cmd.args.empty() && isBuiltin(cmd.args[0])) {
+      cerr << "ulimit: " << cmd.args[0] << ": limits apply to external commands only" << endl;
+      return 1;
     }
-    argv.push_back(nullptr);
-    execv(path.c_str(), argv.data());
-    cerr << "Failed to execute " << path << endl;
-    exit(1);
-  } else if (pid > 0) {
-    int job_num = nextJobNumber();
-    bg_jobs().emplace_back(job_num, pid, command);
-    cout << "[" << job_num << "] " << pid << endl;
-  } else {
-    cerr << "Fork failed" << endl;
+    cmd.limits = limits;
   }
+  return 0;
 }
 
-static bool dispatchBuiltin(string_view program, const CommandInfo& cmd_info) {
-  const vector<string>& args = cmd_info.args;
-  if (program == "exit")    return true;
-  if (program == "echo")    { runEcho(args);     return false; }
-  if (program == "type")    { runType(args);     return false; }
-  if (program == "pwd")     { runPwd();          return false; }
-  if (program == "history") { runHistory(args);  return false; }
-  if (program == "jobs")    { listJobs();        return false; }
-  if (program == "complete"){ runComplete(args); return false; }
-  if (program == "declare") { runDeclare(args);  return false; }
-  if (program == "cd")      { runCd(args);       return false; }
-  return false;
-}
-
-static bool processCommand(const string& command) {
-  PipelineInfo pipeline = parsePipeline(command);
-  if (pipeline.commands.empty() ||
-      (pipeline.commands.size() == 1 && pipeline.commands[0].args.empty())) {
-    return false;
+/**
+ * Executes one pipeline of a command list and returns its exit status.
+ * With @p allow_exec, a plain external command replaces the shell instead
+ * of being spawned (the final command of a `-c` string), unless background
+ * jobs are still queued.
+ */
+static int runPipeline(const PipelineInfo& pipeline, bool allow_exec) {
+  // Paths that launch nothing must not leave the last command's usage.
+  stage_usage().clear();
+  if (pipeline.commands.empty()) return 0;
+  if (pipeline.background) {
+    vector<CommandInfo> commands = pipeline.commands;
+    for (auto& cmd : commands) expandArgs(cmd.args);
+    int status = takePipelineLimits(commands);
+    if (status == 0) status = startBackgroundJob(move(commands), pipeline.text + " &");
+    pipe_status().assign(1, status);
+    return status;
   }
   if (pipeline.has_pipe && pipeline.commands.size() > 1) {
-    executePipeline(pipeline.commands);
-    return false;
+    vector<CommandInfo> commands = pipeline.commands;
+    for (auto& cmd : commands) expandArgs(cmd.args);
+    if (int status = takePipelineLimits(commands)) {
+      pipe_status().assign(1, status);
+      return status;
+    }
+    int status = executePipeline(commands);
+    suspendForeground(exchange(stopped_stages(), {}), pipeline.text);
+    return status;
   }
 
-  CommandInfo cmd_info = pipeline.commands[0];
+  vector<CommandInfo> single(1, pipeline.commands[0]);
+  CommandInfo& cmd_info = single[0];
   vector<string>& args = cmd_info.args;
-
-  if (!args.empty() && args.back() == "&") {
-    args.pop_back();
-    if (args.empty()) return false;
-    expandArgs(args);
-    runBackground(args[0], args, command);
-    return false;
-  }
-
   expandArgs(args);
-  string program = args[0];
+  if (int status = takePipelineLimits(single)) {
+    pipe_status().assign(1, status);
+    return status;
+  }
 
   int saved_stdout = -1;
   int redirect_fd = -1;
@@ -267,30 +171,103 @@ static bool processCommand(const string& command) {
   int error_redirect_fd = -1;
   setupBuiltinRedirects(cmd_info, saved_stdout, redirect_fd, saved_stderr, error_redirect_fd);
 
-  bool should_exit = false;
-  if (isBuiltin(program) || program == "exit") {
-    should_exit = dispatchBuiltin(program, cmd_info);
+  int status = 0;
+  if (args.empty()) {
+    // Redirections alone: the files are created or truncated and nothing runs.
+  } else if (BuiltinHandler builtin = findBuiltin(args[0])) {
+    status = executeBuiltin(builtin, args);
   } else {
     restoreBuiltinRedirects(saved_stdout, redirect_fd, saved_stderr, error_redirect_fd);
+    const string& program = args[0];
     string path = findInPath(program);
-    if (!path.empty()) {
-      executeProgram(path, args,
-                    cmd_info.has_redirect ? cmd_info.output_file : "",
-                    cmd_info.is_append,
-                    cmd_info.has_error_redirect ? cmd_info.error_file : "",
-                    cmd_info.is_error_append);
+    // Queued jobs still need the shell to launch them.
+    if (!path.empty() && allow_exec && !jobsQueued()) {
+      traceDump();
+      execInPlace(path, args, {.output_file = cmd_info.has_redirect ? cmd_info.output_file : "",
+                               .is_append = cmd_info.is_append,
+                               .error_file = cmd_info.has_error_redirect ? cmd_info.error_file : "",
+                               .is_error_append = cmd_info.is_error_append,
+                               .limits = cmd_info.limits});
+      exit_requested() = true;
+      status = 127;
+    } else if (!path.empty()) {
+      status = executeProgram(path, args,
+                              cmd_info.has_redirect ? cmd_info.output_file : "",
+                              cmd_info.is_append,
+                              cmd_info.has_error_redirect ? cmd_info.error_file : "",
+                              cmd_info.is_error_append,
+                              cmd_info.limits);
     } else {
-      cout << program << ": command not found" << endl;
+      cout << program << ": command not found\n";
+      status = 127;
     }
   }
   restoreBuiltinRedirects(saved_stdout, redirect_fd, saved_stderr, error_redirect_fd);
-  return should_exit;
+  suspendForeground(exchange(stopped_stages(), {}), pipeline.text);
+  pipe_status().assign(1, status);
+  return status;
+}
+
+/**
+ * Runs @p pipeline under the `time` keyword: the report is built from the
+ * per-stage wait4() figures the executor leaves in stage_usage().
+ */
+static int runTimedPipeline(const PipelineInfo& pipeline) {
+  double start = monotonicSeconds();
+  int status = runPipeline(pipeline, false);
+  printTimeReport(stage_usage(), monotonicSeconds() - start, pipeline.time_portable);
+  return status;
+}
+
+/**
+ * Parses and runs one input line.  `&&` / `||` elements are skipped based
+ * on the status of the most recently executed pipeline ($?), so
+ * `false && a || b` runs b.  Returns true once the shell should exit.
+ */
+static bool processCommand(const string& command, bool allow_exec = false) {
+  TraceSpan span("processCommand", command);
+  CommandList list;
+  {
+    TraceSpan parse_span("parseCommandList");
+    list = parseCommandList(command);
+  }
+  if (!list.error.empty()) {
+    cerr << "syntax error near unexpected token `" << list.error << "'" << endl;
+    last_status() = 2;
+    return false;
+  }
+  for (size_t i = 0; i < list.items.size() && !exit_requested(); ++i) {
+    const ListItem& item = list.items[i];
+    if (item.op == ListOp::And && last_status() != 0) continue;
+    if (item.op == ListOp::Or && last_status() == 0) continue;
+    bool last = i + 1 == list.items.size();
+    last_status() = item.pipeline.timed && !item.pipeline.background
+                      ? runTimedPipeline(item.pipeline)
+                      : runPipeline(item.pipeline, allow_exec && last);
+  }
+  return exit_requested();
+}
+
+// Distinct first words of the newest history entries that would be looked
+// up on PATH, for the prewarm thread to resolve.
+static vector<string> recentCommands(size_t limit) {
+  vector<string> names;
+  for (int i = history_length - 1; i >= 0 && names.size() < limit; --i) {
+    const HIST_ENTRY* entry = history_get(history_base + i);
+    if (!entry) continue;
+    string_view line = entry->line;
+    line.remove_prefix(min(line.find_first_not_of(" \t"), line.size()));
+    string name(line.substr(0, line.find_first_of(" \t|;&<>")));
+    if (name.empty() || name.find('/') != string::npos || isBuiltin(name)) continue;
+    if (ranges::find(names, name) == names.end()) names.push_back(move(name));
+  }
+  return names;
 }
 
-int main() {
-  initShell();
+static int runInteractive() {
   string histfile = getHistfile();
   loadHistory(histfile);
+  prewarmPathCache(recentCommands(64));
 
   bool should_exit = false;
   do {
@@ -298,10 +275,65 @@ int main() {
     unique_ptr<char, decltype(&free)> raw(readline("$ "), &free);
     if (!raw) break;
     string command(raw.get());
-    if (!command.empty()) add_history(command.c_str());
+    if (!command.empty()) {
+      TraceSpan span("history", "add");
+      if (addHistory(command)) indexHistory(command);
+    }
+    double start = monotonicSeconds();
     should_exit = processCommand(command);
+    recordHistory(histfile, finishHistory(monotonicSeconds() - start, last_status()));
   } while (!should_exit);
 
-  saveHistory(histfile);
-  return 0;
+  trimHistoryFile(histfile, historyFileLimit());
+  traceDump();
+  return last_status();
+}
+
+/**
+ * Runs commands from @p input until it is exhausted or `exit` is seen.  One
+ * line of look-ahead tells us which command is last, so that a `-c` string
+ * (@p exec_last) can exec its final command in place instead of forking.
+ */
+static int runScript(LineReader& input, bool exec_last) {
+  string line;
+  string next;
+  bool more = input.next(line);
+  while (more && !exit_requested()) {
+    bool has_next = input.next(next);
+    string_view trimmed(line);
+    trimmed.remove_prefix(min(trimmed.find_first_not_of(" \t"), trimmed.size()));
+    if (!trimmed.starts_with('#') && processCommand(line, exec_last && !has_next)) break;
+    startQueuedJobs();
+    line.swap(next);
+    more = has_next;
+  }
+  drainJobQueue();
+  cout.flush();
+  traceDump();
+  return last_status();
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && string_view(argv[1]) == "-c") {
+    if (argc < 3) { cerr << argv[0] << ": -c: option requires an argument" << endl; return 2; }
+    initShell(false);
+    LineReader input{string(argv[2])};
+    return runScript(input, true);
+  }
+  if (argc > 1) {
+    int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+    if (fd == -1) { cerr << argv[0] << ": " << argv[1] << ": No such file or directory" << endl; return 127; }
+    initShell(false);
+    LineReader input(fd);
+    int status = runScript(input, false);
+    close(fd);
+    return status;
+  }
+  if (!isatty(STDIN_FILENO)) {
+    initShell(false);
+    LineReader input(STDIN_FILENO);
+    return runScript(input, false);
+  }
+  initShell(true);
+  return runInteractive();
 }
@@ -1,6 +1,6 @@
 /**
  * @file parser.cpp
- * @brief Implementation of parsePipeline().
+ * @brief Implementation of parseCommandList().
  */
 #include "parser.h"
 
@@ -8,37 +8,6 @@
 
 using namespace std;
 
-static pair<bool, vector<string>> splitByPipe(const string& command) {
-  vector<string> segments;
-  string current;
-  bool in_single = false;
-  bool in_double = false;
-  bool has_pipe = false;
-  size_t i = 0;
-  while (i < command.size()) {
-    if (char c = command[i]; c == '\\' && !in_single && i + 1 < command.size()) {
-      current += c;
-      ++i;
-      current += command[i];
-    } else if (c == '\'' && !in_double) {
-      in_single = !in_single;
-      current += c;
-    } else if (c == '"' && !in_single) {
-      in_double = !in_double;
-      current += c;
-    } else if (c == '|' && !in_single && !in_double) {
-      if (!current.empty()) segments.push_back(current);
-      current.clear();
-      has_pipe = true;
-    } else {
-      current += c;
-    }
-    ++i;
-  }
-  if (!current.empty()) segments.push_back(current);
-  return {has_pipe, segments};
-}
-
 static void handleBackslash(const string& str, size_t& i, string& current, bool in_double) {
   if (i + 1 >= str.size()) { current += '\\'; return; }
   char next = str[i + 1];
@@ -46,30 +15,6 @@ static void handleBackslash(const string& str, size_t& i, string& current, bool
   else                                              current += '\\';
 }
 
-static vector<string> tokenise(const string& cmd_str) {
-  vector<string> tokens;
-  string current;
-  bool in_single = false;
-  bool in_double = false;
-  size_t i = 0;
-  while (i < cmd_str.size()) {
-    if (char c = cmd_str[i]; c == '\\' && !in_single) {
-      handleBackslash(cmd_str, i, current, in_double);
-    } else if (c == '\'' && !in_double) {
-      in_single = !in_single;
-    } else if (c == '"' && !in_single) {
-      in_double = !in_double;
-    } else if (isspace(static_cast<unsigned char>(c)) && !in_single && !in_double) {
-      if (!current.empty()) { tokens.push_back(current); current.clear(); }
-    } else {
-      current += c;
-    }
-    ++i;
-  }
-  if (!current.empty()) tokens.push_back(current);
-  return tokens;
-}
-
 static void extractRedirects(vector<string>& args, CommandInfo& info) {
   vector<string> clean;
   size_t i = 0;
@@ -98,19 +43,118 @@ static void extractRedirects(vector<string>& args, CommandInfo& info) {
   args = move(clean);
 }
 
-static CommandInfo parseCommand(const string& cmd_str) {
-  CommandInfo info{};
-  vector<string> args = tokenise(cmd_str);
-  extractRedirects(args, info);
-  info.args = move(args);
-  return info;
+static string trimmed(const string& s, size_t begin, size_t end) {
+  while (begin < end && isspace(static_cast<unsigned char>(s[begin]))) ++begin;
+  while (end > begin && isspace(static_cast<unsigned char>(s[end - 1]))) --end;
+  return s.substr(begin, end - begin);
 }
 
-PipelineInfo parsePipeline(const string& command) {
-  auto [has_pipe, segments] = splitByPipe(command);
-  PipelineInfo pipeline;
-  pipeline.has_pipe = has_pipe;
-  for (const auto& seg : segments)
-    pipeline.commands.push_back(parseCommand(seg));
-  return pipeline;
+namespace {
+
+/** Accumulates tokens, commands and pipelines while the line is scanned. */
+struct ListBuilder {
+  explicit ListBuilder(const string& source) : line(source) {}
+
+  const string& line;
+  CommandList list;
+  PipelineInfo pipeline{};
+  vector<string> tokens;
+  string current;
+  ListOp pending_op = ListOp::Seq;
+  size_t pipeline_start = 0;
+
+  void endWord() {
+    if (!current.empty()) { tokens.push_back(move(current)); current.clear(); }
+  }
+
+  // `time` is a keyword only as the first word of a pipeline.
+  void takeTimeKeyword() {
+    if (!pipeline.commands.empty() || pipeline.timed || tokens[0] != "time") return;
+    pipeline.timed = true;
+    size_t skip = 1;
+    if (tokens.size() > 1 && tokens[1] == "-p") { pipeline.time_portable = true; ++skip; }
+    tokens.erase(tokens.begin(), tokens.begin() + skip);
+  }
+
+  void endCommand() {
+    endWord();
+    if (tokens.empty()) return;
+    takeTimeKeyword();
+    if (tokens.empty()) return;
+    CommandInfo info{};
+    extractRedirects(tokens, info);
+    info.args = move(tokens);
+    tokens.clear();
+    pipeline.commands.push_back(move(info));
+  }
+
+  // True when the current pipeline has no words at all, or ends in a `|`
+  // with nothing after it; an operator in either position is an error.
+  bool incomplete() const {
+    return current.empty() && tokens.empty() &&
+           (pipeline.commands.empty() || pipeline.has_pipe);
+  }
+
+  void endPipeline(size_t end, ListOp next_op, bool background) {
+    endCommand();
+    pipeline.background = background;
+    pipeline.text = trimmed(line, pipeline_start, end);
+    list.items.push_back({pending_op, move(pipeline)});
+    pipeline = PipelineInfo{};
+    pending_op = next_op;
+  }
+};
+
+} // namespace
+
+CommandList parseCommandList(const string& line) {
+  ListBuilder b(line);
+  bool in_single = false;
+  bool in_double = false;
+  size_t i = 0;
+  auto fail = [](string token) {
+    CommandList err;
+    err.error = move(token);
+    return err;
+  };
+
+  while (i < line.size()) {
+    char c = line[i];
+    char next = i + 1 < line.size() ? line[i + 1] : '\0';
+    if (c == '\\' && !in_single) {
+      handleBackslash(line, i, b.current, in_double);
+    } else if (c == '\'' && !in_double) {
+      in_single = !in_single;
+    } else if (c == '"' && !in_single) {
+      in_double = !in_double;
+    } else if (in_single || in_double) {
+      b.current += c;
+    } else if (isspace(static_cast<unsigned char>(c))) {
+      b.endWord();
+    } else if (c == '&' && next != '&' && b.current.ends_with('>')) {
+      b.current += c;  // part of a `>&` redirect word
+    } else if (c == '|' && next != '|') {
+      if (b.current.empty() && b.tokens.empty()) return fail("|");
+      b.endCommand();
+      b.pipeline.has_pipe = true;
+    } else if (c == '|' || c == '&' || c == ';') {
+      bool doubled = c != ';' && next == c;
+      string op = doubled ? string(2, c) : string(1, c);
+      if (b.incomplete()) return fail(op);
+      ListOp next_op = !doubled ? ListOp::Seq : (c == '&' ? ListOp::And : ListOp::Or);
+      b.endPipeline(i, next_op, c == '&' && !doubled);
+      if (doubled) ++i;
+      b.pipeline_start = i + 1;
+    } else {
+      b.current += c;
+    }
+    ++i;
+  }
+
+  if (!b.incomplete()) {
+    b.endPipeline(line.size(), ListOp::Seq, false);
+  } else if (b.pipeline.has_pipe || b.pending_op != ListOp::Seq) {
+    return fail("newline");
+  }
+  return move(b.list);
 }
@@ -1,9 +1,12 @@
 /**
  * @file parser.h
- * @brief Command-line parsing: tokenization, quoting, and pipeline splitting.
+ * @brief Command-line parsing: tokenization, quoting, pipelines and
+ *        command lists.
  */
 #pragma once
 
+#include "rlimits.h"
+
 #include <string>
 #include <vector>
 
@@ -18,6 +21,8 @@
  * @var error_file        Target path for stderr redirection; empty if none.
  * @var has_error_redirect True when a `2>` or `2>>` operator was present.
  * @var is_error_append   True when `2>>` (append) was used instead of `2>`.
+ * @var limits            Resource limits from a `ulimit ... --` prefix, set in
+ *                         the child before it execs.
  */
 struct CommandInfo {
   std::vector<std::string> args;
@@ -27,24 +32,64 @@ struct CommandInfo {
   std::string error_file;
   bool has_error_redirect;
   bool is_error_append;
+  std::vector<ResourceLimit> limits;
 };
 
 /**
- * @brief Parsed representation of a complete input line, potentially
- *        containing multiple commands connected by `|`.
+ * @brief Parsed representation of one pipeline: commands connected by `|`.
  *
- * @var commands   Ordered list of CommandInfo objects, one per pipe-separated segment.
- * @var has_pipe   True when at least one `|` operator separated the commands.
+ * @var commands    Ordered list of CommandInfo objects, one per pipe-separated segment.
+ * @var has_pipe    True when at least one `|` operator separated the commands.
+ * @var background  True when the pipeline was terminated by `&`.
+ * @var text        Source text of the pipeline, trimmed, without the
+ *                  terminating operator.
+ * @var timed       True when the pipeline was prefixed by the `time` keyword.
+ * @var time_portable True for `time -p` (machine-parsable report).
  */
 struct PipelineInfo {
   std::vector<CommandInfo> commands;
   bool has_pipe;
+  bool background;
+  std::string text;
+  bool timed;
+  bool time_portable;
+};
+
+/**
+ * @brief How a list element is joined to the element before it.
+ *
+ * Seq  — `;`, `&`, or start of line: always run.
+ * And  — `&&`: run only if the previous status was 0.
+ * Or   — `||`: run only if the previous status was non-zero.
+ */
+enum class ListOp { Seq, And, Or };
+
+/**
+ * @brief One pipeline of a command list plus the operator that precedes it.
+ */
+struct ListItem {
+  ListOp op;
+  PipelineInfo pipeline;
+};
+
+/**
+ * @brief Parsed representation of a complete input line: pipelines joined
+ *        by `;`, `&`, `&&` and `||`.
+ *
+ * @var items  Pipelines in source order.
+ * @var error  Offending token when the line has a syntax error (items is
+ *             then empty); empty otherwise.
+ */
+struct CommandList {
+  std::vector<ListItem> items;
+  std::string error;
 };
 
 /**
- * @brief Parses a raw command string into a PipelineInfo structure.
+ * @brief Parses a raw command line into a CommandList in a single scan:
+ *        quoting, tokenization and operator splitting happen together.
  *
- * @param[in] command  The raw command line as entered by the user.
- * @return A fully populated PipelineInfo ready for execution.
+ * @param[in] line  The raw command line as entered by the user.
+ * @return A fully populated CommandList ready for execution.
  */
-PipelineInfo parsePipeline(const std::string& command);
+CommandList parseCommandList(const std::string& line);
@@ -0,0 +1,310 @@
+/**
+ * @file pathcache.cpp
+ * @brief Implementation of the hashed command lookup table.
+ */
+#include "pathcache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+struct CachedCommand {
+  string path;
+  string dir;
+  timespec dir_mtime;
+  int hits;
+  bool pinned;
+};
+
+struct NameHash {
+  using is_transparent = void;
+  size_t operator()(string_view s) const { return hash<string_view>{}(s); }
+};
+
+struct CommandTable {
+  unordered_map<string, CachedCommand, NameHash, equal_to<>> entries;
+  string path_env;
+};
+
+struct IndexedDir {
+  string dir;
+  timespec mtime;
+};
+
+/**
+ * Every executable name on PATH, sorted, as of the recorded mtimes.  A
+ * published index is never modified; a rebuild publishes a new one.
+ */
+struct ExecutableIndex {
+  string path_env;
+  vector<IndexedDir> dirs;
+  vector<string> names;
+};
+
+/** Command locations resolved by the prewarm thread, not yet adopted. */
+struct WarmCommands {
+  string path_env;
+  vector<pair<string, CachedCommand>> entries;
+};
+
+} // namespace
+
+static CommandTable& commandTable() {
+  static CommandTable val;
+  return val;
+}
+
+// The two hand-offs between the prewarm thread and the shell.  Both are
+// leaked so a detached worker never outlives them at exit.
+static atomic<shared_ptr<const ExecutableIndex>>& publishedIndex() {
+  static auto* val = new atomic<shared_ptr<const ExecutableIndex>>();
+  return *val;
+}
+
+static atomic<shared_ptr<WarmCommands>>& warmCommands() {
+  static auto* val = new atomic<shared_ptr<WarmCommands>>();
+  return *val;
+}
+
+static bool sameTime(const timespec& a, const timespec& b) {
+  return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static string dirOf(const string& path) {
+  size_t slash = path.rfind('/');
+  if (slash == string::npos) return ".";
+  if (slash == 0) return "/";
+  return path.substr(0, slash);
+}
+
+static bool dirMtime(const string& dir, timespec& out) {
+  struct stat st;
+  if (stat(dir.c_str(), &st) != 0) return false;
+  out = st.st_mtim;
+  return true;
+}
+
+static bool isExecutableFile(const string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && !S_ISDIR(st.st_mode) && (st.st_mode & S_IXUSR);
+}
+
+static bool hasSlash(string_view program) {
+  return program.find('/') != string_view::npos;
+}
+
+// searchPath() against @p path_env rather than the current PATH.
+static string searchPathIn(string_view program, string_view path_env) {
+  // A name with a slash is a path already; PATH plays no part.
+  if (hasSlash(program)) {
+    string path(program);
+    struct stat st;
+    bool runnable = access(path.c_str(), X_OK) == 0 && stat(path.c_str(), &st) == 0 && !S_ISDIR(st.st_mode);
+    return runnable ? path : "";
+  }
+  if (program.empty()) return "";
+  string candidate;
+  while (true) {
+    size_t colon = path_env.find(':');
+    string_view dir = path_env.substr(0, colon);
+    candidate.assign(dir.empty() ? string_view(".") : dir);
+    candidate += '/';
+    candidate += program;
+    if (isExecutableFile(candidate)) return candidate;
+    if (colon == string_view::npos) break;
+    path_env.remove_prefix(colon + 1);
+  }
+  return "";
+}
+
+string searchPath(string_view program) {
+  const char* path_env = getenv("PATH");
+  if (!path_env && !hasSlash(program)) return "";
+  return searchPathIn(program, path_env ? path_env : "");
+}
+
+static void syncWithPath(CommandTable& table) {
+  const char* path_env = getenv("PATH");
+  string_view current = path_env ? path_env : "";
+  if (current != table.path_env) {
+    table.entries.clear();
+    table.path_env = current;
+  }
+  // Adopt whatever the prewarm thread has resolved under the same PATH.
+  // Entries the shell already has win.
+  if (shared_ptr<WarmCommands> warm = warmCommands().exchange(nullptr)) {
+    if (warm->path_env != table.path_env) return;
+    for (auto& [name, entry] : warm->entries) table.entries.try_emplace(move(name), move(entry));
+  }
+}
+
+static bool revalidate(CachedCommand& entry) {
+  timespec now;
+  if (!dirMtime(entry.dir, now)) return false;
+  if (sameTime(now, entry.dir_mtime)) return true;
+  if (!entry.pinned || !isExecutableFile(entry.path)) return false;
+  entry.dir_mtime = now;
+  return true;
+}
+
+string hashLookup(string_view program) {
+  if (hasSlash(program)) return searchPath(program);
+  CommandTable& table = commandTable();
+  syncWithPath(table);
+
+  if (auto it = table.entries.find(program); it != table.entries.end()) {
+    if (revalidate(it->second)) {
+      ++it->second.hits;
+      return it->second.path;
+    }
+    table.entries.erase(it);
+  }
+
+  string path = searchPath(program);
+  if (path.empty()) return path;
+  CachedCommand entry{path, dirOf(path), {}, 1, false};
+  if (dirMtime(entry.dir, entry.dir_mtime))
+    table.entries.emplace(string(program), move(entry));
+  return path;
+}
+
+void hashInsert(string_view program, const string& path) {
+  CommandTable& table = commandTable();
+  syncWithPath(table);
+  CachedCommand entry{path, dirOf(path), {}, 0, true};
+  dirMtime(entry.dir, entry.dir_mtime);
+  table.entries.insert_or_assign(string(program), move(entry));
+}
+
+void hashClear() {
+  commandTable().entries.clear();
+}
+
+vector<HashEntry> hashEntries() {
+  vector<HashEntry> out;
+  out.reserve(commandTable().entries.size());
+  for (const auto& [name, entry] : commandTable().entries) {
+    // Prewarmed entries stay hidden until they are used.
+    if (entry.hits > 0 || entry.pinned) out.push_back({name, entry.path, entry.hits});
+  }
+  ranges::sort(out, {}, &HashEntry::name);
+  return out;
+}
+
+static vector<string> pathDirs(string_view path_env) {
+  vector<string> dirs;
+  while (true) {
+    size_t colon = path_env.find(':');
+    string_view dir = path_env.substr(0, colon);
+    dirs.emplace_back(dir.empty() ? string_view(".") : dir);
+    if (colon == string_view::npos) break;
+    path_env.remove_prefix(colon + 1);
+  }
+  return dirs;
+}
+
+static void addExecutables(const string& dir, vector<string>& names) {
+  DIR* d = opendir(dir.c_str());
+  if (!d) return;
+  int fd = dirfd(d);
+  while (const dirent* entry = readdir(d)) {
+    if (entry->d_name[0] == '.' && (!entry->d_name[1] || (entry->d_name[1] == '.' && !entry->d_name[2])))
+      continue;
+    if (entry->d_type == DT_DIR) continue;
+    struct stat st;
+    if (fstatat(fd, entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+    if (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) names.emplace_back(entry->d_name);
+  }
+  closedir(d);
+}
+
+static bool indexIsCurrent(const ExecutableIndex& index, string_view path_env) {
+  if (path_env != index.path_env) return false;
+  for (const auto& entry : index.dirs) {
+    timespec now{};
+    dirMtime(entry.dir, now);
+    if (!sameTime(now, entry.mtime)) return false;
+  }
+  return true;
+}
+
+static shared_ptr<const ExecutableIndex> buildIndex(string_view path_env) {
+  auto index = make_shared<ExecutableIndex>();
+  index->path_env = path_env;
+  if (!path_env.empty()) {
+    for (auto& dir : pathDirs(path_env)) {
+      timespec mtime{};
+      dirMtime(dir, mtime);
+      addExecutables(dir, index->names);
+      index->dirs.push_back({move(dir), mtime});
+    }
+  }
+  ranges::sort(index->names);
+  index->names.erase(ranges::unique(index->names).begin(), index->names.end());
+  return index;
+}
+
+vector<string> pathExecutables(string_view prefix) {
+  const char* path_env = getenv("PATH");
+  string_view current = path_env ? path_env : "";
+  shared_ptr<const ExecutableIndex> index = publishedIndex().load();
+  if (!index || !indexIsCurrent(*index, current)) {
+    // Not prewarmed yet, or stale: scan now instead of waiting.
+    index = buildIndex(current);
+    publishedIndex().store(index);
+  }
+
+  vector<string> out;
+  for (auto it = ranges::lower_bound(index->names, prefix);
+       it != index->names.end() && it->starts_with(prefix); ++it) {
+    out.push_back(*it);
+  }
+  return out;
+}
+
+static void prewarm(string path_env, vector<string> commands) {
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, nullptr);
+  setpriority(PRIO_PROCESS, gettid(), 19);
+
+  if (!publishedIndex().load()) publishedIndex().store(buildIndex(path_env));
+
+  auto warm = make_shared<WarmCommands>();
+  warm->path_env = path_env;
+  for (auto& name : commands) {
+    if (hasSlash(name)) continue;
+    // PATH as captured when the thread started: the shell may be changing
+    // the environment meanwhile.
+    string path = searchPathIn(name, path_env);
+    if (path.empty()) continue;
+    CachedCommand entry{path, dirOf(path), {}, 0, false};
+    if (dirMtime(entry.dir, entry.dir_mtime)) warm->entries.emplace_back(move(name), move(entry));
+  }
+  warmCommands().store(move(warm));
+}
+
+void prewarmPathCache(vector<string> commands) {
+  const char* path_env = getenv("PATH");
+  try {
+    thread(prewarm, string(path_env ? path_env : ""), move(commands)).detach();
+  } catch (const system_error&) {
+    // No thread: the first Tab and the first lookups scan synchronously.
+  }
+}
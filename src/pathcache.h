@@ -0,0 +1,99 @@
+/**
+ * @file pathcache.h
+ * @brief Hashed command lookup: remembers where PATH commands were found so
+ *        repeated launches skip the directory search.  Also keeps the
+ *        sorted index of PATH executables behind command-name completion.
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Snapshot of a single command-hash entry, as listed by `hash`.
+ *
+ * @var HashEntry::name  Command name as typed by the user.
+ * @var HashEntry::path  Absolute path the name resolves to.
+ * @var HashEntry::hits  Number of lookups served from this entry.
+ */
+struct HashEntry {
+  std::string name;
+  std::string path;
+  int hits;
+};
+
+/**
+ * @brief Resolves @p program against PATH without consulting the hash.
+ *        Costs a single stat() per PATH directory tried.  A name with a
+ *        '/' is not searched for: it is returned as is if it names an
+ *        executable file.
+ *
+ * @param[in] program  Executable name to locate.
+ * @return             Path to the first matching executable, or an empty
+ *                     string if none is found.
+ */
+std::string searchPath(std::string_view program);
+
+/**
+ * @brief Resolves @p program through the command hash, falling back to a
+ *        PATH search on a miss.
+ *
+ * The whole table is discarded when PATH differs from the value it was
+ * built under.  A hit is revalidated with one stat() of the directory that
+ * holds the binary; if that directory's mtime moved, the entry is dropped
+ * and the name is searched again.  Names with a '/' are resolved by
+ * searchPath() every time and never enter the hash.
+ *
+ * @param[in] program  Executable name to locate.
+ * @return             Resolved path, or an empty string if not found.
+ */
+std::string hashLookup(std::string_view program);
+
+/**
+ * @brief Seeds the hash with an explicit resolution (`hash -p`).  The entry
+ *        survives until its binary disappears, `hash -r` or a PATH change.
+ *
+ * @param[in] program  Command name to map.
+ * @param[in] path     Path to associate with @p program.
+ */
+void hashInsert(std::string_view program, const std::string& path);
+
+/** @brief Forgets every remembered location (`hash -r`). */
+void hashClear();
+
+/**
+ * @brief Returns the current entries sorted by name.
+ *
+ * @return A copy of every live entry.
+ */
+std::vector<HashEntry> hashEntries();
+
+/**
+ * @brief Names of the executables on PATH that start with @p prefix,
+ *        sorted and without duplicates.
+ *
+ * Answers from a sorted index of every executable name on PATH with one
+ * binary search plus the matches.  The index is rebuilt only when PATH
+ * changes or one of its directories has a new mtime, which costs one
+ * stat() per directory per call.  If prewarmPathCache() has not yet
+ * published an index, this scans PATH itself rather than wait.
+ *
+ * @param[in] prefix  Leading characters typed so far.
+ * @return            The matching names.
+ */
+std::vector<std::string> pathExecutables(std::string_view prefix);
+
+/**
+ * @brief Starts a detached, low-priority thread that builds the PATH
+ *        executable index and resolves @p commands, so the first Tab and
+ *        the first launches skip the cold directory scans.
+ *
+ * Results are handed over without locks: the index through an atomic
+ * shared_ptr that pathExecutables() loads, the resolved commands through
+ * another that the next hashLookup() takes and merges into the hash.
+ * Adopted commands do not show in hashEntries() until they are used.
+ *
+ * @param[in] commands  Command names worth resolving, e.g. from history.
+ */
+void prewarmPathCache(std::vector<std::string> commands);
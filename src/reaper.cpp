@@ -0,0 +1,128 @@
+/**
+ * @file reaper.cpp
+ * @brief Implementation of the signalfd-driven child reaper.
+ */
+#include "reaper.h"
+#include "trace.h"
+
+#include <cerrno>
+#include <unordered_map>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+struct ChildExit {
+  int wstatus;
+  rusage usage;
+};
+
+} // namespace
+
+static unordered_map<pid_t, ChildExit>& exitedChildren() {
+  static unordered_map<pid_t, ChildExit> val;
+  return val;
+}
+
+static int& signalFd() {
+  static int val = -1;
+  return val;
+}
+
+static sigset_t& savedMask() {
+  static sigset_t val;
+  return val;
+}
+
+static ReapHook& reapHook() {
+  static ReapHook val = nullptr;
+  return val;
+}
+
+void initReaper() {
+  sigset_t chld;
+  sigemptyset(&chld);
+  sigaddset(&chld, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &chld, &savedMask());
+  sigdelset(&savedMask(), SIGCHLD);
+  signalFd() = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+int reaperFd() {
+  return signalFd();
+}
+
+const sigset_t& childSignalMask() {
+  return savedMask();
+}
+
+void setReapHook(ReapHook hook) {
+  reapHook() = hook;
+}
+
+int reapChildren() {
+  // Drain first: a child exiting after the wait4() loop re-arms the fd.
+  signalfd_siginfo info;
+  while (signalFd() != -1 && read(signalFd(), &info, sizeof info) > 0) {}
+  int reaped = 0;
+  int wstatus;
+  rusage usage;
+  pid_t pid;
+  while ((pid = wait4(-1, &wstatus, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+    exitedChildren().insert_or_assign(pid, ChildExit{wstatus, usage});
+    ++reaped;
+  }
+  return reaped;
+}
+
+bool claimExit(pid_t pid, int& wstatus, rusage* usage) {
+  auto it = exitedChildren().find(pid);
+  if (it == exitedChildren().end()) return false;
+  wstatus = it->second.wstatus;
+  if (usage) *usage = it->second.usage;
+  exitedChildren().erase(it);
+  return true;
+}
+
+int exitStatusOf(int wstatus) {
+  if (WIFSIGNALED(wstatus)) return 128 + WTERMSIG(wstatus);
+  if (WIFSTOPPED(wstatus))  return 128 + WSTOPSIG(wstatus);
+  return WEXITSTATUS(wstatus);
+}
+
+vector<pid_t> unclaimedExits() {
+  vector<pid_t> pids;
+  pids.reserve(exitedChildren().size());
+  for (const auto& [pid, exit] : exitedChildren()) pids.push_back(pid);
+  return pids;
+}
+
+void waitForChildEvent() {
+  pollfd fd{signalFd(), POLLIN, 0};
+  while (poll(&fd, 1, -1) == -1 && errno == EINTR) {}
+}
+
+bool waitForExit(pid_t pid, int& wstatus, rusage* usage) {
+  TraceSpan span("wait");
+  if (signalFd() == -1) {
+    pid_t rc;
+    while ((rc = wait4(pid, &wstatus, 0, usage)) == -1 && errno == EINTR) {}
+    return rc == pid;
+  }
+  while (true) {
+    int reaped = reapChildren();
+    if (claimExit(pid, wstatus, usage) && !WIFCONTINUED(wstatus)) return true;
+    if (reaped > 0 && reapHook()) {
+      // The hook may reap too, so look for our exit again before sleeping.
+      reapHook()();
+      continue;
+    }
+    siginfo_t info;
+    if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == -1 && errno == ECHILD) return false;
+    waitForChildEvent();
+  }
+}
@@ -0,0 +1,98 @@
+/**
+ * @file reaper.h
+ * @brief The shell's single child reaper.
+ *
+ * SIGCHLD stays blocked in the shell and is delivered through a signalfd
+ * that the main loop drains synchronously, so nothing is reaped in signal
+ * context.  Every wait4() happens in reapChildren(), which files each exit
+ * under its pid until the foreground waiter or the job table claims it.
+ * Stops and continues are filed the same way; a later event for the same
+ * pid replaces an unclaimed earlier one.
+ */
+#pragma once
+
+#include <csignal>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/**
+ * @brief Called after reapChildren() has collected at least one exit while
+ *        waitForExit() blocks, e.g. to start queued background jobs.
+ */
+using ReapHook = void (*)();
+
+/**
+ * @brief Blocks SIGCHLD and opens the signalfd that reports child exits.
+ *        Call once at startup, before any child is started.
+ */
+void initReaper();
+
+/**
+ * @brief Descriptor that becomes readable when a child has changed state.
+ *
+ * @return The signalfd, or -1 before initReaper().
+ */
+int reaperFd();
+
+/**
+ * @brief Signal mask children should start with: the shell's mask from
+ *        before initReaper() blocked SIGCHLD.
+ */
+const sigset_t& childSignalMask();
+
+/**
+ * @brief Installs @p hook to run whenever waitForExit() reaps other children.
+ *
+ * @param[in] hook  Function to call, or nullptr for none.
+ */
+void setReapHook(ReapHook hook);
+
+/**
+ * @brief Drains the signalfd and collects every exited child without
+ *        blocking.  The only place the shell calls wait4().
+ *
+ * @return Number of children reaped.
+ */
+int reapChildren();
+
+/**
+ * @brief Takes the recorded exit of @p pid, if reapChildren() has seen it.
+ *
+ * @param[in]  pid      Child to look up.
+ * @param[out] wstatus  Raw wait status.
+ * @param[out] usage    If non-null, receives the child's rusage.
+ * @return              true if the exit was recorded (and is now consumed).
+ */
+bool claimExit(pid_t pid, int& wstatus, rusage* usage = nullptr);
+
+/**
+ * @brief Pids whose exits have been recorded but not yet claimed.
+ *
+ * @return A snapshot of the unclaimed pids, in no particular order.
+ */
+std::vector<pid_t> unclaimedExits();
+
+/**
+ * @brief Blocks on the signalfd until child @p pid has exited or stopped.
+ *
+ * @param[in]  pid      Child to wait for.
+ * @param[out] wstatus  Raw wait status.
+ * @param[out] usage    If non-null, receives the child's rusage.
+ * @return              false if @p pid is not a child of the shell.
+ */
+bool waitForExit(pid_t pid, int& wstatus, rusage* usage = nullptr);
+
+/**
+ * @brief Blocks until the signalfd reports a child state change.
+ */
+void waitForChildEvent();
+
+/**
+ * @brief Decodes a raw wait status the way `$?` reports it.
+ *
+ * @param[in] wstatus  Status from wait4() / claimExit().
+ * @return             The exit code, or 128 + signal number if the child
+ *                     was killed or stopped by a signal.
+ */
+int exitStatusOf(int wstatus);
@@ -0,0 +1,104 @@
+/**
+ * @file rlimits.cpp
+ * @brief Implementation of resource-limit parsing and installation.
+ */
+#include "rlimits.h"
+
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+constexpr array<LimitResource, 5> kResources = {{
+  {'c', RLIMIT_CORE,   "core file size",     "blocks",  512},
+  {'n', RLIMIT_NOFILE, "open files",         "",        1},
+  {'t', RLIMIT_CPU,    "cpu time",           "seconds", 1},
+  {'u', RLIMIT_NPROC,  "max user processes", "",        1},
+  {'v', RLIMIT_AS,     "virtual memory",     "kbytes",  1024},
+}};
+
+} // namespace
+
+span<const LimitResource> limitResources() {
+  return kResources;
+}
+
+static const LimitResource* findResource(string_view arg) {
+  if (arg.size() != 2 || arg[0] != '-') return nullptr;
+  auto it = ranges::find(kResources, arg[1], &LimitResource::option);
+  return it == kResources.end() ? nullptr : &*it;
+}
+
+static bool parseValue(string_view text, const LimitResource& res, rlim_t& out) {
+  if (text == "unlimited") { out = RLIM_INFINITY; return true; }
+  rlim_t units = 0;
+  auto [end, ec] = from_chars(text.data(), text.data() + text.size(), units);
+  if (ec != errc() || end != text.data() + text.size()) return false;
+  out = units > RLIM_INFINITY / res.scale ? RLIM_INFINITY : units * res.scale;
+  return true;
+}
+
+bool parseLimitArgs(const vector<string>& args, size_t& pos, LimitRequest& req) {
+  bool soft_only = false;
+  for (; pos < args.size() && args[pos] != "--"; ++pos) {
+    const string& arg = args[pos];
+    if (arg == "-S") { soft_only = true;  req.hard = false; continue; }
+    if (arg == "-H") { soft_only = false; req.hard = true;  continue; }
+    if (arg == "-a") { req.all = true; continue; }
+    const LimitResource* res = findResource(arg);
+    if (!res) {
+      cerr << "ulimit: " << arg << ": invalid option" << endl;
+      cerr << "ulimit: usage: ulimit [-SHa] [-cntuv [limit]] [-- command [args]]" << endl;
+      return false;
+    }
+    bool has_value = pos + 1 < args.size() && args[pos + 1] != "--" && !args[pos + 1].starts_with('-');
+    if (!has_value) { req.show.push_back(res); continue; }
+
+    rlim_t value;
+    if (!parseValue(args[++pos], *res, value)) {
+      cerr << "ulimit: " << args[pos] << ": invalid number" << endl;
+      return false;
+    }
+    ResourceLimit limit{res->resource, {}};
+    getrlimit(res->resource, &limit.limit);
+    if (!req.hard) limit.limit.rlim_cur = value;
+    if (!soft_only) limit.limit.rlim_max = value;
+    // Lowering only the hard limit drags the soft limit down with it.
+    if (limit.limit.rlim_cur > limit.limit.rlim_max) limit.limit.rlim_cur = limit.limit.rlim_max;
+    req.set.push_back(limit);
+  }
+  return true;
+}
+
+bool applyLimits(const vector<ResourceLimit>& limits) {
+  for (const auto& limit : limits) {
+    if (setrlimit(limit.resource, &limit.limit) == 0) continue;
+    auto it = ranges::find(kResources, limit.resource, &LimitResource::resource);
+    cerr << "ulimit: " << it->description << ": cannot modify limit: " << strerror(errno) << endl;
+    return false;
+  }
+  return true;
+}
+
+int takeLimitPrefix(vector<string>& args, vector<ResourceLimit>& limits) {
+  if (args.empty() || args[0] != "ulimit") return 0;
+  auto dashes = ranges::find(args, "--");
+  if (dashes == args.end() || dashes + 1 == args.end()) return 0;
+  size_t pos = 1;
+  LimitRequest req;
+  if (!parseLimitArgs(args, pos, req)) return -1;
+  limits = move(req.set);
+  args.erase(args.begin(), dashes + 1);
+  return 1;
+}
+
+string formatLimit(rlim_t value, const LimitResource& resource) {
+  if (value == RLIM_INFINITY) return "unlimited";
+  return to_string(value / resource.scale);
+}
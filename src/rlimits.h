@@ -0,0 +1,104 @@
+/**
+ * @file rlimits.h
+ * @brief Resource limits for the `ulimit` builtin and for single launches
+ *        (`ulimit -t 10 -- cmd args`).
+ */
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/resource.h>
+
+/**
+ * @brief One resource `ulimit` can change.
+ *
+ * @var LimitResource::option       Option letter (`-t`, `-v`, ...).
+ * @var LimitResource::resource     RLIMIT_* constant.
+ * @var LimitResource::description  Label printed by `ulimit -a`.
+ * @var LimitResource::unit         Unit label printed by `ulimit -a`; empty if none.
+ * @var LimitResource::scale        Bytes (or seconds, ...) per user-visible unit.
+ */
+struct LimitResource {
+  char option;
+  int resource;
+  std::string_view description;
+  std::string_view unit;
+  rlim_t scale;
+};
+
+/**
+ * @brief A fully resolved limit: the soft and hard values to install.
+ *
+ * @var ResourceLimit::resource  RLIMIT_* constant.
+ * @var ResourceLimit::limit     Soft and hard values, in kernel units.
+ */
+struct ResourceLimit {
+  int resource;
+  rlimit limit;
+};
+
+/**
+ * @brief A parsed `ulimit` command line.
+ *
+ * @var LimitRequest::set   Limits to install, resolved against the shell's
+ *                          current limits.
+ * @var LimitRequest::show  Resources to print, in argument order.
+ * @var LimitRequest::all   `-a`: print every resource.
+ * @var LimitRequest::hard  `-H` was given: print hard limits.
+ */
+struct LimitRequest {
+  std::vector<ResourceLimit> set;
+  std::vector<const LimitResource*> show;
+  bool all = false;
+  bool hard = false;
+};
+
+/**
+ * @brief The resources `ulimit` supports: -c -n -t -u -v.
+ */
+std::span<const LimitResource> limitResources();
+
+/**
+ * @brief Parses `[-S|-H] [-a] [-c|-n|-t|-u|-v [value]] ...` starting at
+ *        args[@p pos], stopping at `--` or the end.  A value is a number
+ *        of the resource's units or `unlimited`; `-S` / `-H` restrict a
+ *        change to the soft or hard limit (default: both).
+ *
+ * @param[in]     args  Command words.
+ * @param[in,out] pos   Index of the first option; left at the `--` or end.
+ * @param[out]    req   The parsed request.
+ * @return              false after printing an error.
+ */
+bool parseLimitArgs(const std::vector<std::string>& args, size_t& pos, LimitRequest& req);
+
+/**
+ * @brief Installs @p limits in the calling process with setrlimit().
+ *
+ * @param[in] limits  Limits to install.
+ * @return            false after printing an error for a limit that could
+ *                    not be set.
+ */
+bool applyLimits(const std::vector<ResourceLimit>& limits);
+
+/**
+ * @brief Splits a launch prefix `ulimit [options] -- cmd args...` off
+ *        @p args.
+ *
+ * @param[in,out] args    Command words; on success only `cmd args...` remain.
+ * @param[out]    limits  The limits to apply to the command's processes.
+ * @return                1 if a prefix was removed, 0 if @p args has none,
+ *                        -1 after printing a parse error.
+ */
+int takeLimitPrefix(std::vector<std::string>& args, std::vector<ResourceLimit>& limits);
+
+/**
+ * @brief Formats a kernel limit in @p resource's units.
+ *
+ * @param[in] value     Limit value in kernel units.
+ * @param[in] resource  Resource the value belongs to.
+ * @return              The value divided by the resource's scale, or
+ *                      `unlimited`.
+ */
+std::string formatLimit(rlim_t value, const LimitResource& resource);
@@ -0,0 +1,49 @@
+/**
+ * @file script.cpp
+ * @brief Implementation of the chunked non-interactive line reader.
+ */
+#include "script.h"
+
+#include <cerrno>
+#include <unistd.h>
+
+using namespace std;
+
+static constexpr size_t kChunkSize = 64 * 1024;
+
+LineReader::LineReader(int fd) : fd_(fd) {}
+
+LineReader::LineReader(string text) : buf_(move(text)), eof_(true) {}
+
+bool LineReader::fill() {
+  if (eof_) return false;
+  buf_.erase(0, pos_);
+  pos_ = 0;
+  size_t old_size = buf_.size();
+  buf_.resize(old_size + kChunkSize);
+  ssize_t n;
+  do {
+    n = read(fd_, buf_.data() + old_size, kChunkSize);
+  } while (n < 0 && errno == EINTR);
+  buf_.resize(old_size + (n > 0 ? n : 0));
+  if (n <= 0) eof_ = true;
+  return n > 0;
+}
+
+bool LineReader::next(string& line) {
+  size_t scanned = pos_;
+  while (true) {
+    if (size_t nl = buf_.find('\n', scanned); nl != string::npos) {
+      line.assign(buf_, pos_, nl - pos_);
+      pos_ = nl + 1;
+      return true;
+    }
+    size_t pending = buf_.size() - pos_;
+    if (!fill()) break;
+    scanned = pending;  // fill() moved the unconsumed bytes to the front
+  }
+  if (pos_ >= buf_.size()) return false;
+  line.assign(buf_, pos_);
+  pos_ = buf_.size();
+  return true;
+}
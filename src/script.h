@@ -0,0 +1,37 @@
+/**
+ * @file script.h
+ * @brief Non-interactive input: serves command lines from a `-c` string, a
+ *        script file, or piped stdin without going through readline.
+ */
+#pragma once
+
+#include <string>
+
+/**
+ * @brief Splits input into lines, reading file descriptors in 64 KiB chunks
+ *        rather than one line (or one byte) per system call.
+ */
+class LineReader {
+public:
+  /** @brief Reads lines from @p fd until EOF.  The descriptor is not closed. */
+  explicit LineReader(int fd);
+
+  /** @brief Serves lines from an in-memory string (the `-c` argument). */
+  explicit LineReader(std::string text);
+
+  /**
+   * @brief Fetches the next line, without its trailing newline.
+   *
+   * @param[out] line  Receives the line.
+   * @return           false once the input is exhausted.
+   */
+  bool next(std::string& line);
+
+private:
+  bool fill();
+
+  int fd_ = -1;
+  std::string buf_;
+  size_t pos_ = 0;
+  bool eof_ = false;
+};
@@ -0,0 +1,89 @@
+/**
+ * @file timing.cpp
+ * @brief Implementation of per-stage resource accounting and reporting.
+ */
+#include "timing.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sys/time.h>
+
+using namespace std;
+
+vector<StageUsage>& stage_usage() {
+  static vector<StageUsage> val;
+  return val;
+}
+
+double monotonicSeconds() {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double toSeconds(const timeval& tv) {
+  return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+}
+
+static timeval subtract(const timeval& a, const timeval& b) {
+  timeval out;
+  timersub(&a, &b, &out);
+  return out;
+}
+
+rusage rusageDelta(const rusage& before, const rusage& after) {
+  rusage out{};
+  out.ru_utime  = subtract(after.ru_utime, before.ru_utime);
+  out.ru_stime  = subtract(after.ru_stime, before.ru_stime);
+  out.ru_maxrss = after.ru_maxrss;
+  out.ru_nvcsw  = after.ru_nvcsw - before.ru_nvcsw;
+  out.ru_nivcsw = after.ru_nivcsw - before.ru_nivcsw;
+  return out;
+}
+
+string formatMinSec(double seconds) {
+  long minutes = static_cast<long>(seconds / 60);
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%ldm%.3fs", minutes, seconds - minutes * 60.0);
+  return buf;
+}
+
+void printTimeReport(const vector<StageUsage>& stages, double real, bool portable) {
+  double user = 0;
+  double sys = 0;
+  for (const auto& stage : stages) {
+    user += toSeconds(stage.usage.ru_utime);
+    sys  += toSeconds(stage.usage.ru_stime);
+  }
+
+  char buf[256];
+  if (portable) {
+    snprintf(buf, sizeof(buf), "real %.2f\nuser %.2f\nsys %.2f\n", real, user, sys);
+    cerr << buf;
+    for (size_t i = 0; i < stages.size(); ++i) {
+      const StageUsage& s = stages[i];
+      snprintf(buf, sizeof(buf),
+               "stage=%zu pid=%d real=%.6f user=%.6f sys=%.6f maxrss_kb=%ld nvcsw=%ld nivcsw=%ld command=",
+               i, static_cast<int>(s.pid), s.real, toSeconds(s.usage.ru_utime),
+               toSeconds(s.usage.ru_stime), s.usage.ru_maxrss, s.usage.ru_nvcsw, s.usage.ru_nivcsw);
+      cerr << buf << s.command << '\n';
+    }
+    cerr.flush();
+    return;
+  }
+
+  cerr << "\nreal\t" << formatMinSec(real)
+       << "\nuser\t" << formatMinSec(user)
+       << "\nsys\t"  << formatMinSec(sys) << '\n';
+  // ctxsw is voluntary/involuntary context switches.
+  for (size_t i = 0; i < stages.size(); ++i) {
+    const StageUsage& s = stages[i];
+    snprintf(buf, sizeof(buf),
+             "  [%zu] %-12s real %s  user %s  sys %s  maxrss %ldk  ctxsw %ld/%ld\n",
+             i, s.command.c_str(), formatMinSec(s.real).c_str(),
+             formatMinSec(toSeconds(s.usage.ru_utime)).c_str(),
+             formatMinSec(toSeconds(s.usage.ru_stime)).c_str(),
+             s.usage.ru_maxrss, s.usage.ru_nvcsw, s.usage.ru_nivcsw);
+    cerr << buf;
+  }
+  cerr.flush();
+}
@@ -0,0 +1,64 @@
+/**
+ * @file timing.h
+ * @brief Per-stage resource accounting for the `time` keyword and the
+ *        `times` built-in.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/**
+ * @brief Resources consumed by one stage of a foreground pipeline.
+ *
+ * @var StageUsage::command  Command name (args[0]) of the stage.
+ * @var StageUsage::pid      Child pid, or 0 for a built-in run in the shell.
+ * @var StageUsage::real     Wall-clock seconds from launch until reaped.
+ * @var StageUsage::usage    rusage reported by wait4(), or the shell's own
+ *                           getrusage() delta for an in-process built-in.
+ */
+struct StageUsage {
+  std::string command;
+  pid_t pid;
+  double real;
+  rusage usage;
+};
+
+/**
+ * @brief Stages of the most recent foreground pipeline, in pipeline order.
+ *        Rewritten by every foreground launch.
+ */
+std::vector<StageUsage>& stage_usage();
+
+/** @brief Seconds on the monotonic clock; only differences are meaningful. */
+double monotonicSeconds();
+
+/**
+ * @brief Returns the usage accrued between two getrusage() snapshots.
+ *        ru_maxrss is a high-water mark, so the later value is kept.
+ */
+rusage rusageDelta(const rusage& before, const rusage& after);
+
+/** @brief Converts a timeval to seconds. */
+double toSeconds(const timeval& tv);
+
+/**
+ * @brief Formats @p seconds the way bash's `time` and `times` do: `0m0.004s`.
+ */
+std::string formatMinSec(double seconds);
+
+/**
+ * @brief Writes the `time` report for a finished pipeline to stderr.
+ *
+ * The human form prints bash's real/user/sys block followed by one line per
+ * stage with its wall, user and system time, max RSS and context switches.
+ * The portable form (`time -p`) prints POSIX `real N` lines followed by one
+ * `key=value` line per stage, suitable for scripts to parse.
+ *
+ * @param[in] stages    Stages of the pipeline, in order.
+ * @param[in] real      Wall-clock seconds for the whole pipeline.
+ * @param[in] portable  Selects the `time -p` format.
+ */
+void printTimeReport(const std::vector<StageUsage>& stages, double real, bool portable);
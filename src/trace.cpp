@@ -0,0 +1,159 @@
+/**
+ * @file trace.cpp
+ * @brief Ring-buffer span recorder and Chrome trace-event writer.
+ */
+#include "trace.h"
+#include "globals.h"
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  int64_t ts_us;
+  int64_t dur_us;
+  char detail[64];
+};
+
+constexpr size_t kRingSize = 8192;
+
+struct TraceRing {
+  array<TraceEvent, kRingSize> events;
+  size_t next = 0;
+  size_t count = 0;
+  string path;
+  bool created = false;  // path is a file mkostemps() made for us
+};
+
+} // namespace
+
+static TraceRing& traceRing() {
+  static TraceRing val;
+  return val;
+}
+
+static int64_t nowMicros() {
+  using namespace chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool traceEnabled() {
+  return shell_options().trace_perf;
+}
+
+void traceInit() {
+  if (const char* path = getenv("SHELL_TRACE_PERF"); path && *path) {
+    traceRing().path = path;
+    shell_options().trace_perf = true;
+  }
+}
+
+TraceSpan::TraceSpan(const char* name, string_view detail)
+    : name_(traceEnabled() ? name : nullptr) {
+  if (!name_) return;
+  size_t n = min(detail.size(), sizeof(detail_) - 1);
+  memcpy(detail_, detail.data(), n);
+  start_us_ = nowMicros();
+}
+
+TraceSpan::~TraceSpan() {
+  if (!name_) return;
+  TraceRing& ring = traceRing();
+  TraceEvent& ev = ring.events[ring.next];
+  ev.name = name_;
+  ev.ts_us = start_us_;
+  ev.dur_us = nowMicros() - start_us_;
+  memcpy(ev.detail, detail_, sizeof(ev.detail));
+  ring.next = (ring.next + 1) % kRingSize;
+  ring.count = min(ring.count + 1, kRingSize);
+}
+
+static void writeJsonString(string& out, const char* s) {
+  out += '"';
+  for (; *s; ++s) {
+    auto c = static_cast<unsigned char>(*s);
+    if (c == '"' || c == '\\') { out += '\\'; out += static_cast<char>(c); }
+    else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  out += '"';
+}
+
+// Without SHELL_TRACE_PERF the file gets an unpredictable name under
+// $TMPDIR, created exclusively, so a planted symlink is never followed.
+// Later dumps rewrite that same file.
+static int openTraceFile(TraceRing& ring) {
+  if (!ring.path.empty()) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (ring.created ? O_NOFOLLOW : 0);
+    return open(ring.path.c_str(), flags, ring.created ? 0600 : 0666);
+  }
+  const char* tmpdir = getenv("TMPDIR");
+  string path = string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/shell-trace." +
+                to_string(getpid()) + ".XXXXXX.json";
+  int fd = mkostemps(path.data(), 5, O_CLOEXEC);
+  if (fd == -1) {
+    cerr << "trace: " << path << ": cannot create" << endl;
+    return -1;
+  }
+  ring.path = move(path);
+  ring.created = true;
+  cerr << "trace: writing spans to " << ring.path << endl;
+  return fd;
+}
+
+void traceDump() {
+  TraceRing& ring = traceRing();
+  if (ring.count == 0) return;
+
+  string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  string pid = to_string(getpid());
+  size_t first = (ring.next + kRingSize - ring.count) % kRingSize;
+  for (size_t k = 0; k < ring.count; ++k) {
+    const TraceEvent& ev = ring.events[(first + k) % kRingSize];
+    if (k > 0) out += ",\n";
+    out += "{\"name\":";
+    writeJsonString(out, ev.name);
+    out += ",\"cat\":\"shell\",\"ph\":\"X\",\"pid\":" + pid + ",\"tid\":" + pid;
+    out += ",\"ts\":" + to_string(ev.ts_us) + ",\"dur\":" + to_string(ev.dur_us);
+    if (ev.detail[0]) {
+      out += ",\"args\":{\"detail\":";
+      writeJsonString(out, ev.detail);
+      out += '}';
+    }
+    out += '}';
+  }
+  out += "\n]}\n";
+
+  bool named = !ring.path.empty();
+  int fd = openTraceFile(ring);
+  if (fd == -1) {
+    if (named) cerr << "trace: " << ring.path << ": cannot create" << endl;
+    return;
+  }
+  for (string_view rest = out; !rest.empty();) {
+    ssize_t n = write(fd, rest.data(), rest.size());
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) break;
+    rest.remove_prefix(n);
+  }
+  close(fd);
+  ring.count = 0;
+  ring.next = 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file trace.h
+ * @brief Opt-in execution tracing exported as Chrome trace-event JSON.
+ *
+ * Enabled by `SHELL_TRACE_PERF=<file>` in the environment or at runtime
+ * with `set -o trace-perf`.  Spans are kept in a fixed-size ring buffer (the
+ * oldest are overwritten) and written out on exit or on `set +o trace-perf`.
+ * The output loads directly into chrome://tracing or Perfetto.  When
+ * tracing is off a span costs one branch.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/** @brief True while `set -o trace-perf` is on. */
+bool traceEnabled();
+
+/**
+ * @brief Reads SHELL_TRACE_PERF and enables tracing when it names a file.
+ *        Called once at startup.
+ */
+void traceInit();
+
+/**
+ * @brief Writes the buffered spans to the trace file as Chrome trace-event
+ *        JSON and empties the buffer.  Without SHELL_TRACE_PERF the first
+ *        dump creates $TMPDIR/shell-trace.<pid>.XXXXXX.json (default
+ *        /tmp) with mkostemps(), reports its name on stderr and reuses
+ *        it afterwards.  Does nothing if no span was recorded.
+ */
+void traceDump();
+
+/**
+ * @brief Scoped span: records a complete ("ph":"X") event from construction
+ *        to destruction.
+ *
+ * @p name must be a string literal; @p detail (e.g. the command name) is
+ * truncated to fit the ring-buffer slot.
+ */
+class TraceSpan {
+public:
+  explicit TraceSpan(const char* name, std::string_view detail = {});
+  ~TraceSpan();
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+  const char* name_;
+  int64_t start_us_ = 0;
+  char detail_[64] = {};
+};
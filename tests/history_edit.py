@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""Editing a recalled line and entering it must leave the history intact.
+
+Readline frees the recalled entry and puts a copy in its place; the next
+commands must neither touch the freed entry nor lose track of the copy.
+"""
+import os, re, sys, tempfile
+from session import UP, Terminal, environment, fail
+
+
+def history_after_edit(shell, tmp, control):
+    env = environment(tmp, **({'HISTCONTROL': control} if control else {}))
+    term = Terminal(shell, env)
+    term.line('echo one')
+    term.line('echo two')
+    term.type(UP + UP)
+    term.line('x')
+    term.line('echo one')
+    term.line('echo two')
+    listing = term.line('history')
+    status = term.close()
+    if status != 0:
+        fail(f'HISTCONTROL={control!r}: shell exited with status {status}')
+    return [re.sub(r'^\s*\d+\s+', '', entry) for entry in listing.splitlines() if entry.strip()]
+
+
+def main():
+    shell = os.path.abspath(sys.argv[1])
+    cases = {
+        '': ['echo one', 'echo two', 'echo onex', 'echo one', 'echo two', 'history'],
+        'erasedups': ['echo onex', 'echo one', 'echo two', 'history'],
+    }
+    for control, expected in cases.items():
+        with tempfile.TemporaryDirectory() as tmp:
+            got = history_after_edit(shell, tmp, control)
+        if got != expected:
+            fail(f'HISTCONTROL={control!r}: history is {got}, expected {expected}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""The HISTFILE entries left unread at startup must not be read from a file
+that was trimmed in place in the meantime, even once it has grown back past
+its original size.  The shell's own trim reads them first; after another
+process's rewrite they are dropped rather than read shifted."""
+import os, re, stat, sys, tempfile
+from session import Terminal, environment, fail
+
+OLD_ENTRIES = 3000  # more than the shell reads before its first prompt
+EAGER_ENTRIES = 1000
+APPENDS = 64        # the shell trims the file after this many commands
+
+# Drops the oldest lines in place, as another shell's trim would, and
+# appends enough to make the file larger than before.
+REWRITE = '''#!/bin/sh
+tail -n +101 "$1" > "$1.tail"
+cat "$1.tail" > "$1"
+for i in $(seq 100); do echo "appended by another shell $i" >> "$1"; done
+'''
+
+
+def history_after(shell, tmp, commands):
+    env = environment(tmp, HISTSIZE='-1', HISTFILESIZE=str(OLD_ENTRIES))
+    with open(env['HISTFILE'], 'w') as f:
+        f.writelines(f'old {i}\n' for i in range(OLD_ENTRIES))
+    # Typed ahead, so the deferred entries stay unread until `history`.
+    term = Terminal(shell, env, typeahead=''.join(c + '\n' for c in commands))
+    for _ in commands:
+        term.expect('$ ')
+    listing = term.line('history')
+    term.close()
+    return [re.sub(r'^\s*\d+\s+', '', entry) for entry in listing.splitlines() if entry.strip()]
+
+
+def check(case, got, expected):
+    if got != expected:
+        first = next((i for i, (a, b) in enumerate(zip(got, expected)) if a != b), min(len(got), len(expected)))
+        fail(f'{case}: history differs at entry {first}: got {got[first:first + 3]}, '
+             f'expected {expected[first:first + 3]}')
+
+
+def main():
+    shell = os.path.abspath(sys.argv[1])
+    old = [f'old {i}' for i in range(OLD_ENTRIES)]
+
+    # Longer than the entries the trim drops, so the file ends up larger.
+    commands = [f'echo {i:02} {"x" * 40}' for i in range(APPENDS)]
+    with tempfile.TemporaryDirectory() as tmp:
+        check('own trim', history_after(shell, tmp, commands), old + commands + ['history'])
+
+    with tempfile.TemporaryDirectory() as tmp:
+        rewrite = os.path.join(tmp, 'rewrite')
+        with open(rewrite, 'w') as f:
+            f.write(REWRITE)
+        os.chmod(rewrite, stat.S_IRWXU)
+        commands = [f'{rewrite} {os.path.join(tmp, "history")}']
+        check('rewrite by another process', history_after(shell, tmp, commands),
+              old[-EAGER_ENTRIES:] + commands + ['history'])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,29 @@
+#!/usr/bin/env python3
+"""Background jobs over JOBMAX wait in a queue and are all started as
+running ones finish, including jobs launched under resource limits, whose
+launch waits for a child and can re-enter the queue."""
+import os, sys, tempfile
+from session import environment, fail, run
+
+JOBS = 6
+
+
+def main():
+    shell = os.path.abspath(sys.argv[1])
+    with tempfile.TemporaryDirectory() as tmp:
+        marks = [os.path.join(tmp, f'job{i}') for i in range(JOBS)]
+        script = 'declare JOBMAX=2\n'
+        script += ''.join(f'ulimit -t 5 -- /bin/sh -c "sleep 0.1; touch {mark}" &\n' for mark in marks)
+        script += 'wait\necho status $?\njobs\n'
+        result = run(shell, script, environment(tmp), timeout=20)
+        if result.returncode != 0:
+            fail(f'shell exited with status {result.returncode}: {result.stderr}')
+        if result.stdout.splitlines()[-1:] != ['status 0']:
+            fail(f'wait did not succeed with every job finished: {result.stdout!r}')
+        missing = [mark for mark in marks if not os.path.exists(mark)]
+        if missing:
+            fail(f'{len(missing)} of {JOBS} jobs never ran')
+
+
+if __name__ == '__main__':
+    main()
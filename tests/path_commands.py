@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+"""Commands named by an absolute or relative path run without a PATH search
+and are never entered in the command hash."""
+import os, stat, sys, tempfile
+from session import environment, fail, run
+
+
+def main():
+    shell = os.path.abspath(sys.argv[1])
+    with tempfile.TemporaryDirectory() as tmp:
+        tool = os.path.join(tmp, 'tool')
+        with open(tool, 'w') as f:
+            f.write('#!/bin/sh\necho "tool $1"\n')
+        os.chmod(tool, stat.S_IRWXU)
+        script = (f'{tool} absolute\n'
+                  './tool relative\n'
+                  'echo status $?\n'
+                  './missing\n'
+                  'echo status $?\n'
+                  f'type {tool}\n'
+                  'hash\n')
+        result = run(shell, script, environment(tmp, PATH='/usr/bin:/bin'), cwd=tmp)
+        expected = ['tool absolute', 'tool relative', 'status 0',
+                    './missing: command not found', 'status 127', f'{tool} is {tool}']
+        got = result.stdout.splitlines()
+        if got[:len(expected)] != expected:
+            fail(f'expected {expected}, got {got}')
+        if any('tool' in line for line in got[len(expected):]):
+            fail(f'a path was hashed: {got[len(expected):]}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,29 @@
+#!/usr/bin/env python3
+"""A command made only of redirections creates or truncates its files and
+succeeds, alone, as the last stage of a pipeline and in the background."""
+import os, sys, tempfile
+from session import environment, fail, run
+
+
+def main():
+    shell = os.path.abspath(sys.argv[1])
+    with tempfile.TemporaryDirectory() as tmp:
+        files = [os.path.join(tmp, name) for name in ('alone', 'piped', 'background')]
+        with open(files[0], 'w') as f:
+            f.write('old contents\n')
+        script = (f'> {files[0]}\necho status $?\n'
+                  f'echo a | > {files[1]}\necho status $?\n'
+                  f'2> {files[2]} &\nwait\necho status $?\n')
+        result = run(shell, script, environment(tmp))
+        if result.returncode != 0:
+            fail(f'shell exited with status {result.returncode}: {result.stderr}')
+        statuses = [line for line in result.stdout.splitlines() if line.startswith('status')]
+        if statuses != ['status 0'] * 3:
+            fail(f'expected three zero statuses, got {result.stdout!r}')
+        for path in files:
+            if not os.path.exists(path) or os.path.getsize(path) != 0:
+                fail(f'{path} was not left empty')
+
+
+if __name__ == '__main__':
+    main()
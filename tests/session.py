@@ -0,0 +1,73 @@
+"""Helpers shared by the tests: the shell on a pipe or on a pty.
+
+Every test script takes the shell's path as its first argument and exits
+non-zero with a message on failure.
+"""
+import os, pty, select, subprocess, sys, time
+
+UP = '\x1b[A'
+
+
+def fail(message):
+    sys.exit(f'FAIL: {message}')
+
+
+def environment(tmp, **overrides):
+    """The caller's environment with HISTFILE inside @p tmp and a plain terminal."""
+    env = dict(os.environ, HISTFILE=os.path.join(tmp, 'history'), TERM='dumb')
+    env.pop('HISTCONTROL', None)
+    env.update(overrides)
+    return env
+
+
+def run(shell, script, env, cwd=None, timeout=10):
+    """Runs @p script on the shell's stdin; returns the CompletedProcess."""
+    return subprocess.run([shell], input=script, env=env, cwd=cwd, capture_output=True,
+                          text=True, timeout=timeout)
+
+
+class Terminal:
+    """The shell on a pty, driven one line at a time."""
+
+    def __init__(self, shell, env, typeahead=''):
+        """@p typeahead is queued before the shell starts, so it is read
+        without the shell ever waiting at a prompt."""
+        self.pid, self.fd = pty.fork()
+        if self.pid == 0:
+            os.execve(shell, [shell], env)
+        self.output = ''
+        self.type(typeahead)
+        self.expect('$ ')
+
+    def expect(self, text, timeout=5):
+        """Reads until @p text has appeared since the last expect()."""
+        end = time.monotonic() + timeout
+        while text not in self.output:
+            ready, _, _ = select.select([self.fd], [], [], max(0, end - time.monotonic()))
+            if not ready:
+                fail(f'timed out waiting for {text!r}; got {self.output[-500:]!r}')
+            try:
+                self.output += os.read(self.fd, 4096).decode(errors='replace')
+            except OSError:
+                fail(f'shell exited waiting for {text!r}; got {self.output[-500:]!r}')
+        seen, _, self.output = self.output.partition(text)
+        return seen
+
+    def type(self, keys):
+        os.write(self.fd, keys.encode())
+
+    def line(self, text):
+        """Enters @p text and returns what the shell printed before the next prompt."""
+        self.type(text + '\n')
+        self.expect('\n')
+        return self.expect('$ ')
+
+    def close(self):
+        self.type('exit\n')
+        try:
+            while os.read(self.fd, 4096):
+                pass
+        except OSError:
+            pass
+        _, status = os.waitpid(self.pid, 0)
+        return status